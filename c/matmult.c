@@ -22,6 +22,10 @@
 
 #include <sys/time.h>
 
+#include "mat_type.h"
+#include "mat_kernel.h"
+#include "mat_transpose.h"
+
 /**
  * \brief Default row size.
  */
@@ -32,6 +36,62 @@ static const size_t DEFAULT_ROW_SIZE = 1024;
  */
 static const size_t DEFAULT_COLUMN_SIZE = 1024;
 
+/**
+ * \brief Default L1 block size (rows of first matrix per tile).
+ */
+static const size_t DEFAULT_BLOCK_L1 = 32;
+
+/**
+ * \brief Default L2 block size (common dimension per tile).
+ */
+static const size_t DEFAULT_BLOCK_L2 = 256;
+
+/**
+ * \brief Default L3 block size (columns of second matrix per tile).
+ */
+static const size_t DEFAULT_BLOCK_L3 = 1024;
+
+/**
+ * \brief Default size below which Strassen recursion uses blocked loop.
+ */
+static const size_t DEFAULT_STRASSEN_CUTOFF = 128;
+
+/**
+ * \brief Largest cutoff tried by Strassen auto-tuning.
+ */
+#define MAX_STRASSEN_CUTOFF 512
+
+/**
+ * \brief Size under which recursive algorithm stops splitting.
+ */
+#define RECURSIVE_LEAF 32
+
+/**
+ * \brief Tile size of Morton layout.
+ */
+#define MORTON_TILE 32
+
+/**
+ * \brief Maximum ratio between padded Morton matrixes and the original ones,
+ * beyond it (skinny shapes) recursion runs on row-major matrixes.
+ */
+#define MORTON_MAX_PADDING 4
+
+/**
+ * \enum mat_algorithm
+ * \brief Multiplication algorithm.
+ */
+enum mat_algorithm
+{
+  MAT_NAIVE = 0, /**< Textbook i-j-k loop (reference). */
+  MAT_BLOCK, /**< Cache-blocked (tiled) loop. */
+  MAT_PACKED, /**< Packed panels with register-blocked micro-kernel. */
+  MAT_STRASSEN, /**< Strassen-Winograd recursion over blocked loop. */
+  MAT_RECURSIVE, /**< Cache-oblivious recursion on row-major matrixes. */
+  MAT_MORTON, /**< Cache-oblivious recursion on Morton (Z-order) matrixes. */
+  MAT_TRANSPOSED /**< Dot products with transposed second matrix. */
+};
+
 /**
  * \struct configuration
  * \brief Configuration.
@@ -39,14 +99,39 @@ static const size_t DEFAULT_COLUMN_SIZE = 1024;
 struct configuration
 {
   /**
-   * \brief Row/column size.
+   * \brief Row size of first matrix.
    */
   size_t m;
 
+  /**
+   * \brief Column size of second matrix.
+   */
+  size_t n;
+
+  /**
+   * \brief Common dimension (column size of first matrix).
+   */
+  size_t w;
+
   /**
    * \brief Print input and output matrixes.
    */
   int print_matrix;
+
+  /**
+   * \brief Multiplication algorithm.
+   */
+  enum mat_algorithm algorithm;
+
+  /**
+   * \brief L1, L2 and L3 block sizes for blocked algorithm.
+   */
+  size_t block[3];
+
+  /**
+   * \brief Strassen cutoff (0 to auto-tune).
+   */
+  size_t cutoff;
 };
 
 /**
@@ -64,15 +149,21 @@ static double util_gettime_us(void)
  * \brief Initializes the matrixes.
  * \param mat1 first matrix.
  * \param mat2 second matrix.
- * \param m row size of the matrix.
- * \param n column size of the matrix.
+ * \param m row size of first matrix.
+ * \param n column size of second matrix.
+ * \param w column size of first matrix.
  */
-void mat_init(uint64_t* mat1, uint64_t* mat2, size_t m, size_t n)
+void mat_init(mat_elem_t* mat1, mat_elem_t* mat2, size_t m, size_t n,
+    size_t w)
 {
-  for(size_t i = 0 ; i < (m * n) ; i++)
+  for(size_t i = 0 ; i < (m * w) ; i++)
+  {
+    mat1[i] = MAT_ELEM_INIT(i);
+  }
+
+  for(size_t i = 0 ; i < (w * n) ; i++)
   {
-    mat1[i] = i;
-    mat2[i] = i;
+    mat2[i] = MAT_ELEM_INIT(i);
   }
 }
 
@@ -82,13 +173,13 @@ void mat_init(uint64_t* mat1, uint64_t* mat2, size_t m, size_t n)
  * \param m row size of the matrix.
  * \param n column size of the matrix.
  */
-void mat_print(uint64_t* mat, size_t m, size_t n)
+void mat_print(mat_elem_t* mat, size_t m, size_t n)
 {
   for(size_t i = 0 ; i < m ; i++)
   {
     for(size_t j = 0 ; j < n ; j++)
     {
-      fprintf(stdout, "%lu ", mat[i * m + j]);
+      fprintf(stdout, MAT_ELEM_FMT " ", mat[i * n + j]);
     }
     fprintf(stdout, "\n");
   }
@@ -100,30 +191,775 @@ void mat_print(uint64_t* mat, size_t m, size_t n)
  * \param mat2 second matrix.
  * \param result result matrix.
  * \param m row size of first matrix.
- * \param n column size of first matrix.
- * \param w row size of second matrix.
- * \return 0 if success, -1 if matrixes cannot be multiplied.
+ * \param n column size of second matrix.
+ * \param w column size of first matrix.
+ * \return 0.
  */
-int mat_mult(uint64_t* mat1, uint64_t* mat2, uint64_t* result, size_t m,
-    size_t n, size_t w)
+int mat_mult(const mat_elem_t* restrict mat1, const mat_elem_t* restrict mat2,
+    mat_elem_t* restrict result, size_t m, size_t n, size_t w)
 {
-  if(n != w)
+  for(size_t i = 0 ; i < m ; i++)
+  {
+    for(size_t j = 0 ; j < n ; j++)
+    {
+      mat_elem_t tmp = 0;
+
+      for(size_t k = 0 ; k < w ; k++)
+      {
+        tmp += mat1[i * w + k] * mat2[k * n + j];
+      }
+
+      result[i * n + j] = tmp;
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * \brief Computes a product of strided sub-matrixes with the cache-blocked
+ * loop (see mat_mult_block()).
+ * \param a first matrix.
+ * \param lda row stride of first matrix.
+ * \param b second matrix.
+ * \param ldb row stride of second matrix.
+ * \param c result matrix.
+ * \param ldc row stride of result matrix.
+ * \param m row size of first matrix.
+ * \param n column size of second matrix.
+ * \param w column size of first matrix.
+ * \param l1 number of rows of first matrix per tile.
+ * \param l2 number of common dimension elements per tile.
+ * \param l3 number of columns of second matrix per tile.
+ */
+static void mat_block_strided(const mat_elem_t* restrict a, size_t lda,
+    const mat_elem_t* restrict b, size_t ldb, mat_elem_t* restrict c,
+    size_t ldc, size_t m, size_t n, size_t w, size_t l1, size_t l2, size_t l3)
+{
+  for(size_t i = 0 ; i < m ; i++)
+  {
+    memset(&c[i * ldc], 0x00, n * sizeof(mat_elem_t));
+  }
+
+  for(size_t jj = 0 ; jj < n ; jj += l3)
+  {
+    size_t j_end = jj + l3 < n ? jj + l3 : n;
+
+    for(size_t kk = 0 ; kk < w ; kk += l2)
+    {
+      size_t k_end = kk + l2 < w ? kk + l2 : w;
+
+      for(size_t ii = 0 ; ii < m ; ii += l1)
+      {
+        size_t i_end = ii + l1 < m ? ii + l1 : m;
+
+        for(size_t i = ii ; i < i_end ; i++)
+        {
+          mat_elem_t* restrict res = &c[i * ldc];
+
+          for(size_t k = kk ; k < k_end ; k++)
+          {
+            mat_elem_t av = a[i * lda + k];
+            const mat_elem_t* restrict bk = &b[k * ldb];
+
+            for(size_t j = jj ; j < j_end ; j++)
+            {
+              res[j] += av * bk[j];
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+/**
+ * \brief Performs cache-blocked multiplication of matrixes.
+ *
+ * The j dimension is split in L3 blocks so that a panel of the second
+ * matrix stays in last level cache, the k dimension in L2 blocks and the i
+ * dimension in L1 blocks. Inside a tile, the i-k-j order reads second matrix
+ * and result rows with unit stride.
+ * \param mat1 first matrix.
+ * \param mat2 second matrix.
+ * \param result result matrix.
+ * \param m row size of first matrix.
+ * \param n column size of second matrix.
+ * \param w column size of first matrix.
+ * \param l1 number of rows of first matrix per tile.
+ * \param l2 number of common dimension elements per tile.
+ * \param l3 number of columns of second matrix per tile.
+ * \return 0 if success, -1 if a block size is zero.
+ */
+int mat_mult_block(mat_elem_t* mat1, mat_elem_t* mat2, mat_elem_t* result,
+    size_t m, size_t n, size_t w, size_t l1, size_t l2, size_t l3)
+{
+  if(l1 == 0 || l2 == 0 || l3 == 0)
   {
     return -1;
   }
 
+  mat_block_strided(mat1, w, mat2, n, result, n, m, n, w, l1, l2, l3);
+  return 0;
+}
+
+/**
+ * \brief Adds (sign > 0) or subtracts (sign < 0) two strided matrixes.
+ *
+ * Result may be one of the operands.
+ * \param a first operand.
+ * \param lda row stride of first operand.
+ * \param b second operand.
+ * \param ldb row stride of second operand.
+ * \param c result.
+ * \param ldc row stride of result.
+ * \param rows row size.
+ * \param cols column size.
+ * \param sign sign of second operand.
+ */
+static void mat_strassen_add(const mat_elem_t* a, size_t lda,
+    const mat_elem_t* b, size_t ldb, mat_elem_t* c, size_t ldc, size_t rows,
+    size_t cols, int sign)
+{
+  for(size_t i = 0 ; i < rows ; i++)
+  {
+    const mat_elem_t* ai = &a[i * lda];
+    const mat_elem_t* bi = &b[i * ldb];
+    mat_elem_t* ci = &c[i * ldc];
+
+    if(sign > 0)
+    {
+      for(size_t j = 0 ; j < cols ; j++)
+      {
+        ci[j] = ai[j] + bi[j];
+      }
+    }
+    else
+    {
+      for(size_t j = 0 ; j < cols ; j++)
+      {
+        ci[j] = ai[j] - bi[j];
+      }
+    }
+  }
+}
+
+/**
+ * \brief Returns the number of scratch elements needed by
+ * mat_strassen_rec().
+ * \param m row size of first matrix.
+ * \param n column size of second matrix.
+ * \param w column size of first matrix.
+ * \param levels number of recursion levels.
+ * \return number of elements.
+ */
+static size_t mat_strassen_scratch(size_t m, size_t n, size_t w,
+    size_t levels)
+{
+  size_t size = 0;
+
+  for(size_t l = 0 ; l < levels ; l++)
+  {
+    m /= 2;
+    n /= 2;
+    w /= 2;
+
+    /* X holds sums of first matrix and P1, Y holds sums of second matrix */
+    size += m * (w > n ? w : n) + w * n;
+  }
+
+  return size;
+}
+
+/**
+ * \brief Strassen-Winograd recursion (7 multiplications, 15 additions).
+ *
+ * Uses the schedule of Boyer, Dumas, Pernet and Zhou ("Memory efficient
+ * scheduling of Strassen-Winograd's matrix multiplication algorithm", 2009)
+ * that needs only two temporaries per level, taken from scratch. Sizes must
+ * be multiple of 2^levels.
+ * \param a first matrix.
+ * \param lda row stride of first matrix.
+ * \param b second matrix.
+ * \param ldb row stride of second matrix.
+ * \param c result matrix.
+ * \param ldc row stride of result matrix.
+ * \param m row size of first matrix.
+ * \param n column size of second matrix.
+ * \param w column size of first matrix.
+ * \param levels remaining recursion levels.
+ * \param scratch scratch buffer (see mat_strassen_scratch()).
+ * \param block L1, L2 and L3 block sizes of base case.
+ */
+static void mat_strassen_rec(const mat_elem_t* a, size_t lda,
+    const mat_elem_t* b, size_t ldb, mat_elem_t* c, size_t ldc, size_t m,
+    size_t n, size_t w, size_t levels, mat_elem_t* scratch,
+    const size_t* block)
+{
+  size_t hm = m / 2;
+  size_t hn = n / 2;
+  size_t hw = w / 2;
+  const mat_elem_t* a11 = a;
+  const mat_elem_t* a12 = a + hw;
+  const mat_elem_t* a21 = a + hm * lda;
+  const mat_elem_t* a22 = a21 + hw;
+  const mat_elem_t* b11 = b;
+  const mat_elem_t* b12 = b + hn;
+  const mat_elem_t* b21 = b + hw * ldb;
+  const mat_elem_t* b22 = b21 + hn;
+  mat_elem_t* c11 = c;
+  mat_elem_t* c12 = c + hn;
+  mat_elem_t* c21 = c + hm * ldc;
+  mat_elem_t* c22 = c21 + hn;
+  /* X is hm x hw for sums of first matrix and hm x hn for P1 */
+  size_t ldx = hw > hn ? hw : hn;
+  mat_elem_t* x = scratch;
+  mat_elem_t* y = x + hm * ldx;
+  mat_elem_t* next = y + hw * hn;
+
+  if(levels == 0)
+  {
+    mat_block_strided(a, lda, b, ldb, c, ldc, m, n, w, block[0], block[1],
+        block[2]);
+    return;
+  }
+
+  levels--;
+
+  /* S3 = A11 - A21, T3 = B22 - B12, P7 = S3 T3 in C21 */
+  mat_strassen_add(a11, lda, a21, lda, x, ldx, hm, hw, -1);
+  mat_strassen_add(b22, ldb, b12, ldb, y, hn, hw, hn, -1);
+  mat_strassen_rec(x, ldx, y, hn, c21, ldc, hm, hn, hw, levels, next, block);
+
+  /* S1 = A21 + A22, T1 = B12 - B11, P5 = S1 T1 in C22 */
+  mat_strassen_add(a21, lda, a22, lda, x, ldx, hm, hw, 1);
+  mat_strassen_add(b12, ldb, b11, ldb, y, hn, hw, hn, -1);
+  mat_strassen_rec(x, ldx, y, hn, c22, ldc, hm, hn, hw, levels, next, block);
+
+  /* S2 = S1 - A11, T2 = B22 - T1, P6 = S2 T2 in C12 */
+  mat_strassen_add(x, ldx, a11, lda, x, ldx, hm, hw, -1);
+  mat_strassen_add(b22, ldb, y, hn, y, hn, hw, hn, -1);
+  mat_strassen_rec(x, ldx, y, hn, c12, ldc, hm, hn, hw, levels, next, block);
+
+  /* S4 = A12 - S2, P3 = S4 B22 in C11 */
+  mat_strassen_add(a12, lda, x, ldx, x, ldx, hm, hw, -1);
+  mat_strassen_rec(x, ldx, b22, ldb, c11, ldc, hm, hn, hw, levels, next,
+      block);
+
+  /* P1 = A11 B11 in X */
+  mat_strassen_rec(a11, lda, b11, ldb, x, ldx, hm, hn, hw, levels, next,
+      block);
+
+  /* U2 = P1 + P6, U3 = U2 + P7, U4 = U2 + P5, U7 = U3 + P5, U5 = U4 + P3 */
+  mat_strassen_add(x, ldx, c12, ldc, c12, ldc, hm, hn, 1);
+  mat_strassen_add(c12, ldc, c21, ldc, c21, ldc, hm, hn, 1);
+  mat_strassen_add(c12, ldc, c22, ldc, c12, ldc, hm, hn, 1);
+  mat_strassen_add(c21, ldc, c22, ldc, c22, ldc, hm, hn, 1);
+  mat_strassen_add(c12, ldc, c11, ldc, c12, ldc, hm, hn, 1);
+
+  /* T4 = T2 - B21, P4 = A22 T4 in C11, U6 = U3 - P4 */
+  mat_strassen_add(y, hn, b21, ldb, y, hn, hw, hn, -1);
+  mat_strassen_rec(a22, lda, y, hn, c11, ldc, hm, hn, hw, levels, next,
+      block);
+  mat_strassen_add(c21, ldc, c11, ldc, c21, ldc, hm, hn, -1);
+
+  /* P2 = A12 B21 in C11, U1 = P1 + P2 */
+  mat_strassen_rec(a12, lda, b21, ldb, c11, ldc, hm, hn, hw, levels, next,
+      block);
+  mat_strassen_add(x, ldx, c11, ldc, c11, ldc, hm, hn, 1);
+}
+
+/**
+ * \brief Returns the number of Strassen levels for a problem, that is the
+ * number of halvings until the smallest dimension reaches cutoff.
+ * \param m row size of first matrix.
+ * \param n column size of second matrix.
+ * \param w column size of first matrix.
+ * \param cutoff size below which blocked loop is used.
+ * \return number of levels.
+ */
+static size_t mat_strassen_levels(size_t m, size_t n, size_t w,
+    size_t cutoff)
+{
+  size_t min = m < n ? (m < w ? m : w) : (n < w ? n : w);
+  size_t levels = 0;
+
+  while(((min + (1 << levels) - 1) >> levels) > cutoff)
+  {
+    levels++;
+  }
+
+  return levels;
+}
+
+/**
+ * \brief Performs Strassen-Winograd multiplication of matrixes.
+ *
+ * Recursion stops when the smallest dimension is below cutoff and the
+ * cache-blocked loop computes the remaining products. Dimensions that are not
+ * multiple of 2^levels are zero-padded in temporary copies. All temporary
+ * memory is allocated once before recursion.
+ * \param mat1 first matrix.
+ * \param mat2 second matrix.
+ * \param result result matrix.
+ * \param m row size of first matrix.
+ * \param n column size of second matrix.
+ * \param w column size of first matrix.
+ * \param cutoff size below which blocked loop is used.
+ * \param block L1, L2 and L3 block sizes of blocked loop.
+ * \return 0 if success, -1 if memory cannot be allocated or cutoff or a block
+ * size is zero.
+ */
+int mat_mult_strassen(mat_elem_t* mat1, mat_elem_t* mat2, mat_elem_t* result,
+    size_t m, size_t n, size_t w, size_t cutoff, const size_t* block)
+{
+  size_t levels = 0;
+  size_t align = 0;
+  size_t pm = 0;
+  size_t pn = 0;
+  size_t pw = 0;
+  int padded = 0;
+  mat_elem_t* scratch = NULL;
+  mat_elem_t* a = mat1;
+  mat_elem_t* b = mat2;
+  mat_elem_t* c = result;
+
+  if(cutoff == 0 || block[0] == 0 || block[1] == 0 || block[2] == 0)
+  {
+    return -1;
+  }
+
+  levels = mat_strassen_levels(m, n, w, cutoff);
+  align = (size_t)1 << levels;
+  pm = (m + align - 1) / align * align;
+  pn = (n + align - 1) / align * align;
+  pw = (w + align - 1) / align * align;
+  padded = pm != m || pn != n || pw != w;
+
+  /* scratch for recursion followed by padded copies if needed */
+  scratch = malloc((mat_strassen_scratch(pm, pn, pw, levels) +
+      (padded ? pm * pw + pw * pn + pm * pn : 0)) * sizeof(mat_elem_t));
+
+  if(!scratch)
+  {
+    return -1;
+  }
+
+  if(padded)
+  {
+    a = scratch + mat_strassen_scratch(pm, pn, pw, levels);
+    b = a + pm * pw;
+    c = b + pw * pn;
+
+    memset(a, 0x00, (pm * pw + pw * pn) * sizeof(mat_elem_t));
+
+    for(size_t i = 0 ; i < m ; i++)
+    {
+      memcpy(&a[i * pw], &mat1[i * w], w * sizeof(mat_elem_t));
+    }
+
+    for(size_t i = 0 ; i < w ; i++)
+    {
+      memcpy(&b[i * pn], &mat2[i * n], n * sizeof(mat_elem_t));
+    }
+  }
+
+  mat_strassen_rec(a, pw, b, pn, c, pn, pm, pn, pw, levels, scratch, block);
+
+  if(padded)
+  {
+    for(size_t i = 0 ; i < m ; i++)
+    {
+      memcpy(&result[i * n], &c[i * pn], n * sizeof(mat_elem_t));
+    }
+  }
+
+  free(scratch);
+  return 0;
+}
+
+/**
+ * \brief Finds the Strassen cutoff for this machine.
+ *
+ * For growing sizes s, compares blocked loop on 2s x 2s matrixes with one
+ * Strassen-Winograd level over it, and returns the first s for which
+ * Strassen-Winograd is faster.
+ * \param block L1, L2 and L3 block sizes of blocked loop.
+ * \return cutoff.
+ */
+size_t mat_strassen_tune(const size_t* block)
+{
+  size_t cutoff = 0;
+
+  for(size_t s = 32 ; s <= MAX_STRASSEN_CUTOFF && !cutoff ; s *= 2)
+  {
+    size_t size = 2 * s;
+    mat_elem_t* mat1 = malloc(3 * size * size * sizeof(mat_elem_t));
+    mat_elem_t* mat2 = mat1 ? mat1 + size * size : NULL;
+    mat_elem_t* mat3 = mat1 ? mat2 + size * size : NULL;
+    double block_time = 0;
+    double strassen_time = 0;
+
+    if(!mat1)
+    {
+      break;
+    }
+
+    mat_init(mat1, mat2, size, size, size);
+
+    /* best of three runs for each */
+    for(int r = 0 ; r < 3 ; r++)
+    {
+      double start = util_gettime_us();
+      double t = 0;
+
+      mat_mult_block(mat1, mat2, mat3, size, size, size, block[0], block[1],
+          block[2]);
+      t = util_gettime_us() - start;
+      block_time = (r == 0 || t < block_time) ? t : block_time;
+
+      start = util_gettime_us();
+      if(mat_mult_strassen(mat1, mat2, mat3, size, size, size, s,
+            block) != 0)
+      {
+        break;
+      }
+      t = util_gettime_us() - start;
+      strassen_time = (r == 0 || t < strassen_time) ? t : strassen_time;
+    }
+
+    if(strassen_time > 0 && strassen_time < block_time)
+    {
+      cutoff = s;
+    }
+
+    free(mat1);
+  }
+
+  return cutoff ? cutoff : MAX_STRASSEN_CUTOFF;
+}
+
+/**
+ * \brief Adds the product of strided sub-matrixes to result with the i-k-j
+ * loop. It is the leaf of recursive algorithms.
+ * \param a first matrix.
+ * \param lda row stride of first matrix.
+ * \param b second matrix.
+ * \param ldb row stride of second matrix.
+ * \param c result matrix.
+ * \param ldc row stride of result matrix.
+ * \param m row size of first matrix.
+ * \param n column size of second matrix.
+ * \param w column size of first matrix.
+ */
+static void mat_leaf(const mat_elem_t* restrict a, size_t lda,
+    const mat_elem_t* restrict b, size_t ldb, mat_elem_t* restrict c,
+    size_t ldc, size_t m, size_t n, size_t w)
+{
   for(size_t i = 0 ; i < m ; i++)
   {
-    for(size_t j = 0 ; j < n ; j++)
+    mat_elem_t* restrict res = &c[i * ldc];
+
+    for(size_t k = 0 ; k < w ; k++)
     {
-      uint64_t tmp = 0;
+      mat_elem_t av = a[i * lda + k];
+      const mat_elem_t* restrict bk = &b[k * ldb];
 
-      for(size_t k = 0 ; k < w ; k++)
+      for(size_t j = 0 ; j < n ; j++)
       {
-        tmp += mat1[i * w + k] * mat2[k * n + j];
+        res[j] += av * bk[j];
+      }
+    }
+  }
+}
+
+/**
+ * \brief Cache-oblivious recursion: splits the largest dimension in two
+ * until sub-problems fit in the leaf.
+ * \param a first matrix.
+ * \param lda row stride of first matrix.
+ * \param b second matrix.
+ * \param ldb row stride of second matrix.
+ * \param c result matrix.
+ * \param ldc row stride of result matrix.
+ * \param m row size of first matrix.
+ * \param n column size of second matrix.
+ * \param w column size of first matrix.
+ */
+static void mat_recursive_rec(const mat_elem_t* a, size_t lda,
+    const mat_elem_t* b, size_t ldb, mat_elem_t* c, size_t ldc, size_t m,
+    size_t n, size_t w)
+{
+  if(m <= RECURSIVE_LEAF && n <= RECURSIVE_LEAF && w <= RECURSIVE_LEAF)
+  {
+    mat_leaf(a, lda, b, ldb, c, ldc, m, n, w);
+  }
+  else if(m >= n && m >= w)
+  {
+    size_t h = m / 2;
+
+    mat_recursive_rec(a, lda, b, ldb, c, ldc, h, n, w);
+    mat_recursive_rec(a + h * lda, lda, b, ldb, c + h * ldc, ldc, m - h, n,
+        w);
+  }
+  else if(n >= w)
+  {
+    size_t h = n / 2;
+
+    mat_recursive_rec(a, lda, b, ldb, c, ldc, m, h, w);
+    mat_recursive_rec(a, lda, b + h, ldb, c + h, ldc, m, n - h, w);
+  }
+  else
+  {
+    /* both halves accumulate in the same result */
+    size_t h = w / 2;
+
+    mat_recursive_rec(a, lda, b, ldb, c, ldc, m, n, h);
+    mat_recursive_rec(a + h, lda, b + h * ldb, ldb, c, ldc, m, n, w - h);
+  }
+}
+
+/**
+ * \brief Performs cache-oblivious recursive multiplication of matrixes.
+ *
+ * Halving the largest dimension makes sub-problems fit in each cache level
+ * in turn without knowing cache sizes, so no tuning is needed per machine.
+ * \param mat1 first matrix.
+ * \param mat2 second matrix.
+ * \param result result matrix.
+ * \param m row size of first matrix.
+ * \param n column size of second matrix.
+ * \param w column size of first matrix.
+ * \return 0.
+ */
+int mat_mult_recursive(mat_elem_t* mat1, mat_elem_t* mat2, mat_elem_t* result,
+    size_t m, size_t n, size_t w)
+{
+  memset(result, 0x00, m * n * sizeof(mat_elem_t));
+  mat_recursive_rec(mat1, w, mat2, n, result, n, m, n, w);
+  return 0;
+}
+
+/**
+ * \brief Returns the position of a tile in Morton (Z-order) layout, that is
+ * the interleaved bits of its row (odd bits) and column (even bits).
+ * \param ti tile row.
+ * \param tj tile column.
+ * \return Morton index.
+ */
+static size_t mat_morton_index(size_t ti, size_t tj)
+{
+  size_t z = 0;
+
+  for(size_t bit = 0 ; (ti | tj) >> bit ; bit++)
+  {
+    z |= ((tj >> bit) & 1) << (2 * bit);
+    z |= ((ti >> bit) & 1) << (2 * bit + 1);
+  }
+
+  return z;
+}
+
+/**
+ * \brief Returns the number of tiles per side of Morton matrixes for a
+ * problem, that is the power of two covering all dimensions.
+ * \param m row size of first matrix.
+ * \param n column size of second matrix.
+ * \param w column size of first matrix.
+ * \return number of tiles per side.
+ */
+size_t mat_morton_tiles(size_t m, size_t n, size_t w)
+{
+  size_t max = m > n ? (m > w ? m : w) : (n > w ? n : w);
+  size_t tiles = 1;
+
+  while(tiles * MORTON_TILE < max)
+  {
+    tiles *= 2;
+  }
+
+  return tiles;
+}
+
+/**
+ * \brief Converts a row-major matrix to Morton layout.
+ *
+ * Morton matrix is made of tiles x tiles square tiles of MORTON_TILE
+ * elements per side stored in Z-order, each tile is row-major. Elements
+ * outside source are zeroed.
+ * \param src row-major matrix.
+ * \param rows row size of source.
+ * \param cols column size of source.
+ * \param dst Morton matrix (tiles^2 * MORTON_TILE^2 elements).
+ * \param tiles number of tiles per side (power of two).
+ */
+void mat_to_morton(const mat_elem_t* src, size_t rows, size_t cols,
+    mat_elem_t* dst, size_t tiles)
+{
+  for(size_t ti = 0 ; ti < tiles ; ti++)
+  {
+    for(size_t tj = 0 ; tj < tiles ; tj++)
+    {
+      mat_elem_t* tile = &dst[mat_morton_index(ti, tj) * MORTON_TILE *
+        MORTON_TILE];
+
+      for(size_t i = 0 ; i < MORTON_TILE ; i++)
+      {
+        size_t row = ti * MORTON_TILE + i;
+
+        for(size_t j = 0 ; j < MORTON_TILE ; j++)
+        {
+          size_t col = tj * MORTON_TILE + j;
+
+          tile[i * MORTON_TILE + j] = (row < rows && col < cols) ?
+            src[row * cols + col] : 0;
+        }
       }
+    }
+  }
+}
+
+/**
+ * \brief Converts a Morton matrix (see mat_to_morton()) to row-major layout.
+ * \param src Morton matrix.
+ * \param tiles number of tiles per side.
+ * \param dst row-major matrix.
+ * \param rows row size of destination.
+ * \param cols column size of destination.
+ */
+void mat_from_morton(const mat_elem_t* src, size_t tiles, mat_elem_t* dst,
+    size_t rows, size_t cols)
+{
+  assert(rows <= tiles * MORTON_TILE && cols <= tiles * MORTON_TILE);
+  (void)tiles;
+
+  for(size_t row = 0 ; row < rows ; row++)
+  {
+    size_t ti = row / MORTON_TILE;
+    size_t i = row % MORTON_TILE;
 
-      result[i * m + j] = tmp;
+    for(size_t tj = 0 ; tj * MORTON_TILE < cols ; tj++)
+    {
+      const mat_elem_t* tile = &src[mat_morton_index(ti, tj) * MORTON_TILE *
+        MORTON_TILE];
+      size_t len = cols - tj * MORTON_TILE;
+
+      memcpy(&dst[row * cols + tj * MORTON_TILE], &tile[i * MORTON_TILE],
+          (len < MORTON_TILE ? len : MORTON_TILE) * sizeof(mat_elem_t));
+    }
+  }
+}
+
+/**
+ * \brief Quadtree recursion over Morton matrixes: each quadrant of a Z-order
+ * matrix is contiguous and itself in Z-order.
+ * \param a first matrix.
+ * \param b second matrix.
+ * \param c result matrix.
+ * \param tiles number of tiles per side.
+ */
+static void mat_morton_rec(const mat_elem_t* a, const mat_elem_t* b,
+    mat_elem_t* c, size_t tiles)
+{
+  size_t q = 0;
+
+  if(tiles == 1)
+  {
+    mat_leaf(a, MORTON_TILE, b, MORTON_TILE, c, MORTON_TILE, MORTON_TILE,
+        MORTON_TILE, MORTON_TILE);
+    return;
+  }
+
+  /* quadrants 0, 1, 2 and 3 are top-left, top-right, bottom-left and
+   * bottom-right
+   */
+  tiles /= 2;
+  q = tiles * tiles * MORTON_TILE * MORTON_TILE;
+
+  mat_morton_rec(a, b, c, tiles);
+  mat_morton_rec(a + q, b + 2 * q, c, tiles);
+  mat_morton_rec(a, b + q, c + q, tiles);
+  mat_morton_rec(a + q, b + 3 * q, c + q, tiles);
+  mat_morton_rec(a + 2 * q, b, c + 2 * q, tiles);
+  mat_morton_rec(a + 3 * q, b + 2 * q, c + 2 * q, tiles);
+  mat_morton_rec(a + 2 * q, b + q, c + 3 * q, tiles);
+  mat_morton_rec(a + 3 * q, b + 3 * q, c + 3 * q, tiles);
+}
+
+/**
+ * \brief Performs cache-oblivious recursive multiplication of matrixes in
+ * Morton layout.
+ *
+ * Matrixes are converted to Morton layout, padded to a square power of two
+ * number of tiles, multiplied and result is converted back. Conversions are
+ * part of the measured time. Shapes whose padding would exceed
+ * MORTON_MAX_PADDING times the size of the matrixes use
+ * mat_mult_recursive() instead.
+ * \param mat1 first matrix.
+ * \param mat2 second matrix.
+ * \param result result matrix.
+ * \param m row size of first matrix.
+ * \param n column size of second matrix.
+ * \param w column size of first matrix.
+ * \return 0 if success, -1 if memory cannot be allocated.
+ */
+int mat_mult_morton(mat_elem_t* mat1, mat_elem_t* mat2, mat_elem_t* result,
+    size_t m, size_t n, size_t w)
+{
+  size_t tiles = mat_morton_tiles(m, n, w);
+  size_t nb = tiles * tiles * MORTON_TILE * MORTON_TILE;
+  mat_elem_t* a = NULL;
+  mat_elem_t* b = NULL;
+  mat_elem_t* c = NULL;
+
+  /* a single square tile count wastes memory and time on skinny shapes */
+  if(3 * nb > MORTON_MAX_PADDING * (m * w + w * n + m * n))
+  {
+    return mat_mult_recursive(mat1, mat2, result, m, n, w);
+  }
+
+  a = malloc(3 * nb * sizeof(mat_elem_t));
+
+  if(!a)
+  {
+    return -1;
+  }
+
+  b = a + nb;
+  c = b + nb;
+
+  mat_to_morton(mat1, m, w, a, tiles);
+  mat_to_morton(mat2, w, n, b, tiles);
+  memset(c, 0x00, nb * sizeof(mat_elem_t));
+
+  mat_morton_rec(a, b, c, tiles);
+
+  mat_from_morton(c, tiles, result, m, n);
+  free(a);
+  return 0;
+}
+
+/**
+ * \brief Performs multiplication of matrixes with transposed second matrix
+ * (see mat_transpose()), each element of result is a dot product of two
+ * contiguous rows.
+ * \param mat1 first matrix.
+ * \param mat2t transposed second matrix (n x w).
+ * \param result result matrix.
+ * \param m row size of first matrix.
+ * \param n column size of second matrix.
+ * \param w column size of first matrix.
+ * \return 0.
+ */
+int mat_mult_transposed(const mat_elem_t* restrict mat1,
+    const mat_elem_t* restrict mat2t, mat_elem_t* restrict result, size_t m,
+    size_t n, size_t w)
+{
+  for(size_t i = 0 ; i < m ; i++)
+  {
+    for(size_t j = 0 ; j < n ; j++)
+    {
+      result[i * n + j] = mat_dot(&mat1[i * w], &mat2t[j * w], w);
     }
   }
 
@@ -136,10 +972,21 @@ int mat_mult(uint64_t* mat1, uint64_t* mat2, uint64_t* result, size_t m,
  */
 void print_help(const char* program)
 {
-  fprintf(stdout, "Usage: %s [-m row size] [-p] [-h]\n\n"
+  fprintf(stdout, "Usage: %s [-m size] [-M rows] [-K common] [-N columns] "
+      "[-a algorithm] [-b l1,l2,l3] [-s cutoff] [-p] [-h]\n\n"
       "  -h\t\tDisplay this help\n"
       "  -p\t\tPrint the input and output matrixes\n"
-      "  -m row\tRow/column size (default 1024)\n", program);
+      "  -m size\tSize of square matrixes (default 1024)\n"
+      "  -M rows\tRow size of first matrix (default -m)\n"
+      "  -K common\tColumn size of first matrix (default -m)\n"
+      "  -N columns\tColumn size of second matrix (default -m)\n"
+      "  -a algo\tAlgorithm: naive, block, packed, strassen, recursive,\n"
+      "\t\tmorton, transpose (default naive)\n"
+      "  -b l1,l2,l3\tBlock sizes for block algorithm (default %zu,%zu,%zu)\n"
+      "  -s cutoff\tSize below which strassen uses block algorithm, auto to\n"
+      "\t\tmeasure it (default %zu)\n",
+      program, DEFAULT_BLOCK_L1, DEFAULT_BLOCK_L2, DEFAULT_BLOCK_L3,
+      DEFAULT_STRASSEN_CUTOFF);
 }
 
 /**
@@ -155,12 +1002,22 @@ int parse_cmdline(int argc, char** argv,
   /*
    * h: print help and exit
    * p: print input and output matrixes
-   * m: row size
+   * m: square size
+   * M: row size of first matrix
+   * K: common dimension
+   * N: column size of second matrix
+   * a: algorithm
+   * b: block sizes
+   * s: Strassen cutoff
    */
-  static const char* options = "hpm:";
+  static const char* options = "hpm:M:K:N:a:b:s:";
   int opt = 0;
   int print_matrix = 0;
-  uint64_t m = DEFAULT_ROW_SIZE;
+  long m = DEFAULT_ROW_SIZE;
+  long dims[3] = {0, 0, 0};
+  enum mat_algorithm algorithm = MAT_NAIVE;
+  size_t block[3] = {DEFAULT_BLOCK_L1, DEFAULT_BLOCK_L2, DEFAULT_BLOCK_L3};
+  size_t cutoff = DEFAULT_STRASSEN_CUTOFF;
   int ret = 1;
 
   assert(configuration);
@@ -185,6 +1042,74 @@ int parse_cmdline(int argc, char** argv,
           ret = -1;
         }
         break;
+      case 'M':
+      case 'K':
+      case 'N':
+        dims[opt == 'M' ? 0 : opt == 'K' ? 1 : 2] = atol(optarg);
+        if(atol(optarg) < 1)
+        {
+          fprintf(stderr, "Bad argument for '-%c': %s\n", opt, optarg);
+          ret = -1;
+        }
+        break;
+      case 'a':
+        if(!strcmp(optarg, "naive"))
+        {
+          algorithm = MAT_NAIVE;
+        }
+        else if(!strcmp(optarg, "block"))
+        {
+          algorithm = MAT_BLOCK;
+        }
+        else if(!strcmp(optarg, "packed"))
+        {
+          algorithm = MAT_PACKED;
+        }
+        else if(!strcmp(optarg, "strassen"))
+        {
+          algorithm = MAT_STRASSEN;
+        }
+        else if(!strcmp(optarg, "recursive"))
+        {
+          algorithm = MAT_RECURSIVE;
+        }
+        else if(!strcmp(optarg, "morton"))
+        {
+          algorithm = MAT_MORTON;
+        }
+        else if(!strcmp(optarg, "transpose"))
+        {
+          algorithm = MAT_TRANSPOSED;
+        }
+        else
+        {
+          fprintf(stderr, "Bad argument for '-a': %s\n", optarg);
+          ret = -1;
+        }
+        break;
+      case 'b':
+        if(sscanf(optarg, "%zu,%zu,%zu", &block[0], &block[1], &block[2]) != 3
+            || block[0] == 0 || block[1] == 0 || block[2] == 0)
+        {
+          fprintf(stderr, "Bad argument for '-b': %s\n", optarg);
+          ret = -1;
+        }
+        break;
+      case 's':
+        if(!strcmp(optarg, "auto"))
+        {
+          cutoff = 0;
+        }
+        else if(atol(optarg) < 1)
+        {
+          fprintf(stderr, "Bad argument for '-s': %s\n", optarg);
+          ret = -1;
+        }
+        else
+        {
+          cutoff = atol(optarg);
+        }
+        break;
       default:
         fprintf(stderr, "Bad option (%c)\n", optopt);
         ret = -1;
@@ -193,7 +1118,12 @@ int parse_cmdline(int argc, char** argv,
   }
 
   configuration->print_matrix = print_matrix;
-  configuration->m = m;
+  configuration->m = dims[0] ? (size_t)dims[0] : (size_t)m;
+  configuration->w = dims[1] ? (size_t)dims[1] : (size_t)m;
+  configuration->n = dims[2] ? (size_t)dims[2] : (size_t)m;
+  configuration->algorithm = algorithm;
+  memcpy(configuration->block, block, sizeof(block));
+  configuration->cutoff = cutoff;
 
   return ret;
 }
@@ -206,9 +1136,10 @@ int parse_cmdline(int argc, char** argv,
  */
 int main(int argc, char** argv)
 {
-  uint64_t* mat1 = NULL;
-  uint64_t* mat2 = NULL;
-  uint64_t* mat3 = NULL;
+  mat_elem_t* mat1 = NULL;
+  mat_elem_t* mat2 = NULL;
+  mat_elem_t* mat2t = NULL;
+  mat_elem_t* mat3 = NULL;
   size_t m = DEFAULT_ROW_SIZE;
   size_t n = DEFAULT_COLUMN_SIZE;
   size_t w = DEFAULT_COLUMN_SIZE;
@@ -231,14 +1162,14 @@ int main(int argc, char** argv)
   }
 
   m = config.m;
-  n = config.m;
-  w = config.m;
+  n = config.n;
+  w = config.w;
   print_matrix = config.print_matrix;
 
   nb_elements = m * n;
-  mat1 = malloc(nb_elements * sizeof(uint64_t));
-  mat2 = malloc(nb_elements * sizeof(uint64_t));
-  mat3 = malloc(nb_elements * sizeof(uint64_t));
+  mat1 = mat_alloc(m * w);
+  mat2 = mat_alloc(w * n);
+  mat3 = mat_alloc(nb_elements);
 
   if(!mat1 || !mat2 || !mat3)
   {
@@ -249,18 +1180,76 @@ int main(int argc, char** argv)
     exit(EXIT_FAILURE);
   }
 
-  mat_init(mat1, mat2, m, n);
+  mat_init(mat1, mat2, m, n, w);
 
   if(print_matrix)
   {
     printf("Matrix 1:\n");
-    mat_print(mat1, m, n);
+    mat_print(mat1, m, w);
     printf("Matrix 2:\n");
-    mat_print(mat2, m, n);
+    mat_print(mat2, w, n);
+  }
+
+  if(config.algorithm == MAT_PACKED)
+  {
+    fprintf(stdout, "Packed kernel: %s\n", mat_kernel_default()->name);
+  }
+  else if(config.algorithm == MAT_STRASSEN)
+  {
+    if(config.cutoff == 0)
+    {
+      config.cutoff = mat_strassen_tune(config.block);
+      fprintf(stdout, "Strassen cutoff: %zu (auto-tuned)\n", config.cutoff);
+    }
+    else
+    {
+      fprintf(stdout, "Strassen cutoff: %zu\n", config.cutoff);
+    }
+  }
+  else if(config.algorithm == MAT_TRANSPOSED)
+  {
+    mat2t = mat_transpose_timed(mat2, n, w, NULL, NULL);
+
+    if(!mat2t)
+    {
+      perror("malloc");
+      free(mat1);
+      free(mat2);
+      free(mat3);
+      exit(EXIT_FAILURE);
+    }
   }
 
   start = util_gettime_us();
-  if(mat_mult(mat1, mat2, mat3, m, n, w) == -1)
+  switch(config.algorithm)
+  {
+    case MAT_BLOCK:
+      ret = mat_mult_block(mat1, mat2, mat3, m, n, w, config.block[0],
+          config.block[1], config.block[2]);
+      break;
+    case MAT_PACKED:
+      ret = mat_kernel_packed(mat1, mat2, mat3, m, n, w, 0, m);
+      break;
+    case MAT_STRASSEN:
+      ret = mat_mult_strassen(mat1, mat2, mat3, m, n, w, config.cutoff,
+          config.block);
+      break;
+    case MAT_RECURSIVE:
+      ret = mat_mult_recursive(mat1, mat2, mat3, m, n, w);
+      break;
+    case MAT_MORTON:
+      ret = mat_mult_morton(mat1, mat2, mat3, m, n, w);
+      break;
+    case MAT_TRANSPOSED:
+      ret = mat_mult_transposed(mat1, mat2t, mat3, m, n, w);
+      break;
+    case MAT_NAIVE:
+    default:
+      ret = mat_mult(mat1, mat2, mat3, m, n, w);
+      break;
+  }
+
+  if(ret == -1)
   {
     fprintf(stderr, "Matrixes cannot be multiplied\n");
     ret = EXIT_FAILURE;
@@ -273,7 +1262,7 @@ int main(int argc, char** argv)
 
     if(print_matrix)
     {
-      mat_print(mat3, w, m);
+      mat_print(mat3, m, n);
     }
     ret = EXIT_SUCCESS;
   }
@@ -281,6 +1270,7 @@ int main(int argc, char** argv)
   /* free resources */
   free(mat1);
   free(mat2);
+  free(mat2t);
   free(mat3);
 
   return ret;
@@ -0,0 +1,711 @@
+/*
+ * Copyright (c) 2026, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file mat_kernel.c
+ * \brief Packed matrix multiplication kernels shared by CPU backends.
+ * \author Sebastien Vincent
+ * \date 2026
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "mat_kernel.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+/**
+ * \def MAT_KERNEL_X86
+ * \brief Enables x86 SIMD micro-kernels.
+ */
+#define MAT_KERNEL_X86 1
+
+#include <immintrin.h>
+#endif
+
+/**
+ * \def MAT_KERNEL_SCALAR_MR
+ * \brief Rows computed by the scalar micro-kernel.
+ */
+#define MAT_KERNEL_SCALAR_MR 4
+
+/**
+ * \def MAT_KERNEL_SCALAR_NR
+ * \brief Columns computed by the scalar micro-kernel.
+ */
+#define MAT_KERNEL_SCALAR_NR 4
+
+/**
+ * \brief Scalar 4x4 micro-kernel.
+ * \param kc common dimension size.
+ * \param a packed panel of first matrix.
+ * \param b packed panel of second matrix.
+ * \param c result block.
+ * \param ldc row stride of result.
+ * \param rows number of valid rows in result block.
+ * \param cols number of valid columns in result block.
+ */
+static void mat_kernel_micro_scalar(size_t kc, const mat_elem_t* a,
+    const mat_elem_t* b, mat_elem_t* c, size_t ldc, size_t rows, size_t cols)
+{
+  mat_elem_t acc[MAT_KERNEL_SCALAR_MR][MAT_KERNEL_SCALAR_NR] = {{0}};
+
+  for(size_t p = 0 ; p < kc ; p++)
+  {
+    /* full unroll keeps accumulators in registers */
+    #pragma GCC unroll 8
+    for(size_t i = 0 ; i < MAT_KERNEL_SCALAR_MR ; i++)
+    {
+      mat_elem_t av = a[i];
+
+      #pragma GCC unroll 8
+      for(size_t j = 0 ; j < MAT_KERNEL_SCALAR_NR ; j++)
+      {
+        acc[i][j] += av * b[j];
+      }
+    }
+
+    a += MAT_KERNEL_SCALAR_MR;
+    b += MAT_KERNEL_SCALAR_NR;
+  }
+
+  for(size_t i = 0 ; i < rows ; i++)
+  {
+    for(size_t j = 0 ; j < cols ; j++)
+    {
+      c[i * ldc + j] += acc[i][j];
+    }
+  }
+}
+
+#ifdef MAT_KERNEL_X86
+
+/**
+ * \def MAT_KERNEL_MICRO
+ * \brief Defines a SIMD micro-kernel.
+ *
+ * The micro-kernel keeps a mr x nv block of vectors in registers, so it
+ * computes mr rows and nv * (vector size / element size) columns of result.
+ * \param name name of the function.
+ * \param isa instruction sets used (target attribute).
+ * \param vec vector type.
+ * \param lanes number of elements per vector.
+ * \param mr number of rows.
+ * \param nv number of vectors per row.
+ * \param zero returns a zero vector.
+ * \param load loads a vector from an unaligned address.
+ * \param bcast broadcasts an element to all lanes.
+ * \param madd returns acc + a * b.
+ * \param store stores a vector to an unaligned address.
+ */
+#define MAT_KERNEL_MICRO(name, isa, vec, lanes, mr, nv, zero, load, bcast, \
+    madd, store) \
+__attribute__((target(isa))) \
+static void name(size_t kc, const mat_elem_t* a, const mat_elem_t* b, \
+    mat_elem_t* c, size_t ldc, size_t rows, size_t cols) \
+{ \
+  vec acc[mr][nv]; \
+  mat_elem_t tmp[mr][(nv) * (lanes)]; \
+\
+  for(size_t i = 0 ; i < (mr) ; i++) \
+  { \
+    for(size_t v = 0 ; v < (nv) ; v++) \
+    { \
+      acc[i][v] = zero(); \
+    } \
+  } \
+\
+  for(size_t p = 0 ; p < kc ; p++) \
+  { \
+    vec bv[nv]; \
+\
+    _Pragma("GCC unroll 4") \
+    for(size_t v = 0 ; v < (nv) ; v++) \
+    { \
+      bv[v] = load(&b[v * (lanes)]); \
+    } \
+\
+    _Pragma("GCC unroll 16") \
+    for(size_t i = 0 ; i < (mr) ; i++) \
+    { \
+      vec av = bcast(a[i]); \
+\
+      _Pragma("GCC unroll 4") \
+      for(size_t v = 0 ; v < (nv) ; v++) \
+      { \
+        acc[i][v] = madd(acc[i][v], av, bv[v]); \
+      } \
+    } \
+\
+    a += (mr); \
+    b += (nv) * (lanes); \
+  } \
+\
+  for(size_t i = 0 ; i < (mr) ; i++) \
+  { \
+    for(size_t v = 0 ; v < (nv) ; v++) \
+    { \
+      store(&tmp[i][v * (lanes)], acc[i][v]); \
+    } \
+  } \
+\
+  for(size_t i = 0 ; i < rows ; i++) \
+  { \
+    for(size_t j = 0 ; j < cols ; j++) \
+    { \
+      c[i * ldc + j] += tmp[i][j]; \
+    } \
+  } \
+}
+
+/**
+ * \def MAT_KERNEL_LANES256
+ * \brief Number of elements in a 256-bit vector.
+ */
+#define MAT_KERNEL_LANES256 (32 / sizeof(mat_elem_t))
+
+/**
+ * \def MAT_KERNEL_LANES512
+ * \brief Number of elements in a 512-bit vector.
+ */
+#define MAT_KERNEL_LANES512 (64 / sizeof(mat_elem_t))
+
+/**
+ * \brief Checks AVX2 support (and FMA for floating-point types).
+ * \return 1 if supported, 0 otherwise.
+ */
+static int mat_kernel_supported_avx2(void)
+{
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") &&
+    (!MAT_ELEM_FLOATING || __builtin_cpu_supports("fma")) ? 1 : 0;
+}
+
+/**
+ * \brief Checks AVX-512F support.
+ * \return 1 if AVX-512F is supported, 0 otherwise.
+ */
+static int mat_kernel_supported_avx512(void)
+{
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx512f") ? 1 : 0;
+}
+
+#if MAT_TYPE == MAT_UINT64 || MAT_TYPE == MAT_INT64
+
+/*
+ * 64-bit integers: AVX2 and AVX-512F have no 64-bit low multiplication, it is
+ * built from 32-bit multiplications (vpmuludq) as
+ * lo(a) * lo(b) + ((hi(a) * lo(b) + lo(a) * hi(b)) << 32), which gives the
+ * same bits for signed and unsigned elements. AVX-512DQ has native vpmullq:
+ * one instruction replaces three vpmuludq, two shifts and two additions of
+ * the emulation, so it comes first when supported.
+ */
+
+/**
+ * \brief Checks AVX-512F and AVX-512DQ support.
+ * \return 1 if AVX-512DQ is supported, 0 otherwise.
+ */
+static int mat_kernel_supported_avx512dq(void)
+{
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx512f") &&
+    __builtin_cpu_supports("avx512dq") ? 1 : 0;
+}
+
+/**
+ * \brief Multiply-accumulate of 64-bit integers with AVX2.
+ * \param acc accumulator.
+ * \param a first operand.
+ * \param b second operand.
+ * \return acc + a * b (low 64-bit of products).
+ */
+__attribute__((target("avx2")))
+static inline __m256i mat_kernel_madd_epi64_avx2(__m256i acc, __m256i a,
+    __m256i b)
+{
+  __m256i lo = _mm256_mul_epu32(a, b);
+  __m256i cross = _mm256_add_epi64(
+      _mm256_mul_epu32(_mm256_srli_epi64(a, 32), b),
+      _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32)));
+
+  return _mm256_add_epi64(acc,
+      _mm256_add_epi64(lo, _mm256_slli_epi64(cross, 32)));
+}
+
+/**
+ * \brief Multiply-accumulate of 64-bit integers with AVX-512F.
+ * \param acc accumulator.
+ * \param a first operand.
+ * \param b second operand.
+ * \return acc + a * b (low 64-bit of products).
+ */
+__attribute__((target("avx512f")))
+static inline __m512i mat_kernel_madd_epi64_avx512(__m512i acc, __m512i a,
+    __m512i b)
+{
+  __m512i lo = _mm512_mul_epu32(a, b);
+  __m512i cross = _mm512_add_epi64(
+      _mm512_mul_epu32(_mm512_srli_epi64(a, 32), b),
+      _mm512_mul_epu32(a, _mm512_srli_epi64(b, 32)));
+
+  return _mm512_add_epi64(acc,
+      _mm512_add_epi64(lo, _mm512_slli_epi64(cross, 32)));
+}
+
+#define MAT_KERNEL_LOAD256(p) _mm256_loadu_si256((const __m256i*)(p))
+#define MAT_KERNEL_STORE256(p, v) _mm256_storeu_si256((__m256i*)(p), (v))
+#define MAT_KERNEL_BCAST256(x) _mm256_set1_epi64x((long long)(x))
+#define MAT_KERNEL_BCAST512(x) _mm512_set1_epi64((long long)(x))
+#define MAT_KERNEL_MADD512DQ(acc, a, b) \
+  _mm512_add_epi64((acc), _mm512_mullo_epi64((a), (b)))
+
+#define MAT_KERNEL_AVX2_MR 4
+#define MAT_KERNEL_AVX2_NV 2
+#define MAT_KERNEL_AVX512_MR 8
+#define MAT_KERNEL_AVX512_NV 2
+
+MAT_KERNEL_MICRO(mat_kernel_micro_avx2, "avx2", __m256i, MAT_KERNEL_LANES256,
+    MAT_KERNEL_AVX2_MR, MAT_KERNEL_AVX2_NV, _mm256_setzero_si256,
+    MAT_KERNEL_LOAD256, MAT_KERNEL_BCAST256, mat_kernel_madd_epi64_avx2,
+    MAT_KERNEL_STORE256)
+
+MAT_KERNEL_MICRO(mat_kernel_micro_avx512, "avx512f", __m512i,
+    MAT_KERNEL_LANES512, MAT_KERNEL_AVX512_MR, MAT_KERNEL_AVX512_NV,
+    _mm512_setzero_si512, _mm512_loadu_si512, MAT_KERNEL_BCAST512,
+    mat_kernel_madd_epi64_avx512, _mm512_storeu_si512)
+
+MAT_KERNEL_MICRO(mat_kernel_micro_avx512dq, "avx512f,avx512dq", __m512i,
+    MAT_KERNEL_LANES512, MAT_KERNEL_AVX512_MR, MAT_KERNEL_AVX512_NV,
+    _mm512_setzero_si512, _mm512_loadu_si512, MAT_KERNEL_BCAST512,
+    MAT_KERNEL_MADD512DQ, _mm512_storeu_si512)
+
+#elif MAT_TYPE == MAT_INT32
+
+/* 32-bit integers: native low multiplication (vpmulld) */
+
+#define MAT_KERNEL_LOAD256(p) _mm256_loadu_si256((const __m256i*)(p))
+#define MAT_KERNEL_STORE256(p, v) _mm256_storeu_si256((__m256i*)(p), (v))
+#define MAT_KERNEL_BCAST256(x) _mm256_set1_epi32((int)(x))
+#define MAT_KERNEL_BCAST512(x) _mm512_set1_epi32((int)(x))
+#define MAT_KERNEL_MADD256(acc, a, b) \
+  _mm256_add_epi32((acc), _mm256_mullo_epi32((a), (b)))
+#define MAT_KERNEL_MADD512(acc, a, b) \
+  _mm512_add_epi32((acc), _mm512_mullo_epi32((a), (b)))
+
+#define MAT_KERNEL_AVX2_MR 6
+#define MAT_KERNEL_AVX2_NV 2
+#define MAT_KERNEL_AVX512_MR 8
+#define MAT_KERNEL_AVX512_NV 2
+
+MAT_KERNEL_MICRO(mat_kernel_micro_avx2, "avx2", __m256i, MAT_KERNEL_LANES256,
+    MAT_KERNEL_AVX2_MR, MAT_KERNEL_AVX2_NV, _mm256_setzero_si256,
+    MAT_KERNEL_LOAD256, MAT_KERNEL_BCAST256, MAT_KERNEL_MADD256,
+    MAT_KERNEL_STORE256)
+
+MAT_KERNEL_MICRO(mat_kernel_micro_avx512, "avx512f", __m512i,
+    MAT_KERNEL_LANES512, MAT_KERNEL_AVX512_MR, MAT_KERNEL_AVX512_NV,
+    _mm512_setzero_si512, _mm512_loadu_si512, MAT_KERNEL_BCAST512,
+    MAT_KERNEL_MADD512, _mm512_storeu_si512)
+
+#elif MAT_TYPE == MAT_DOUBLE
+
+/* double: fused multiply-add, 6x8 on AVX2 and 8x16 on AVX-512 */
+
+#define MAT_KERNEL_MADD256(acc, a, b) _mm256_fmadd_pd((a), (b), (acc))
+#define MAT_KERNEL_MADD512(acc, a, b) _mm512_fmadd_pd((a), (b), (acc))
+
+#define MAT_KERNEL_AVX2_MR 6
+#define MAT_KERNEL_AVX2_NV 2
+#define MAT_KERNEL_AVX512_MR 8
+#define MAT_KERNEL_AVX512_NV 2
+
+MAT_KERNEL_MICRO(mat_kernel_micro_avx2, "avx2,fma", __m256d,
+    MAT_KERNEL_LANES256, MAT_KERNEL_AVX2_MR, MAT_KERNEL_AVX2_NV,
+    _mm256_setzero_pd, _mm256_loadu_pd, _mm256_set1_pd, MAT_KERNEL_MADD256,
+    _mm256_storeu_pd)
+
+MAT_KERNEL_MICRO(mat_kernel_micro_avx512, "avx512f", __m512d,
+    MAT_KERNEL_LANES512, MAT_KERNEL_AVX512_MR, MAT_KERNEL_AVX512_NV,
+    _mm512_setzero_pd, _mm512_loadu_pd, _mm512_set1_pd, MAT_KERNEL_MADD512,
+    _mm512_storeu_pd)
+
+#elif MAT_TYPE == MAT_FLOAT
+
+/* float: fused multiply-add, 6x16 on AVX2 and 8x32 on AVX-512 */
+
+#define MAT_KERNEL_MADD256(acc, a, b) _mm256_fmadd_ps((a), (b), (acc))
+#define MAT_KERNEL_MADD512(acc, a, b) _mm512_fmadd_ps((a), (b), (acc))
+
+#define MAT_KERNEL_AVX2_MR 6
+#define MAT_KERNEL_AVX2_NV 2
+#define MAT_KERNEL_AVX512_MR 8
+#define MAT_KERNEL_AVX512_NV 2
+
+MAT_KERNEL_MICRO(mat_kernel_micro_avx2, "avx2,fma", __m256,
+    MAT_KERNEL_LANES256, MAT_KERNEL_AVX2_MR, MAT_KERNEL_AVX2_NV,
+    _mm256_setzero_ps, _mm256_loadu_ps, _mm256_set1_ps, MAT_KERNEL_MADD256,
+    _mm256_storeu_ps)
+
+MAT_KERNEL_MICRO(mat_kernel_micro_avx512, "avx512f", __m512,
+    MAT_KERNEL_LANES512, MAT_KERNEL_AVX512_MR, MAT_KERNEL_AVX512_NV,
+    _mm512_setzero_ps, _mm512_loadu_ps, _mm512_set1_ps, MAT_KERNEL_MADD512,
+    _mm512_storeu_ps)
+
+#endif /* MAT_TYPE */
+
+#endif /* MAT_KERNEL_X86 */
+
+/**
+ * \brief Available micro-kernels, from the fastest to the most portable one.
+ *
+ * AVX-512 comes before AVX2 for all types: twice the lanes and more
+ * registers (bigger micro-tile) outweigh frequency drops on CPUs that
+ * throttle on 512-bit instructions for the sizes worth packing, the gap of
+ * small matrixes being within run-to-run noise. MAT_KERNEL environment
+ * variable forces another kernel where it does not hold.
+ */
+static const struct mat_kernel mat_kernels[] =
+{
+#ifdef MAT_KERNEL_X86
+#if MAT_TYPE == MAT_UINT64 || MAT_TYPE == MAT_INT64
+  {"avx512dq", MAT_KERNEL_AVX512_MR,
+    MAT_KERNEL_AVX512_NV * MAT_KERNEL_LANES512, mat_kernel_supported_avx512dq,
+    mat_kernel_micro_avx512dq},
+#endif
+  {"avx512", MAT_KERNEL_AVX512_MR, MAT_KERNEL_AVX512_NV * MAT_KERNEL_LANES512,
+    mat_kernel_supported_avx512, mat_kernel_micro_avx512},
+  {"avx2", MAT_KERNEL_AVX2_MR, MAT_KERNEL_AVX2_NV * MAT_KERNEL_LANES256,
+    mat_kernel_supported_avx2, mat_kernel_micro_avx2},
+#endif
+  {"scalar", MAT_KERNEL_SCALAR_MR, MAT_KERNEL_SCALAR_NR, NULL,
+    mat_kernel_micro_scalar},
+};
+
+/**
+ * \brief Packs a mc x kc block of first matrix in panels of mr rows.
+ *
+ * Each panel stores, for every k, the mr elements of its rows. Missing rows
+ * of the last panel are zero-padded.
+ * \param src first element of the block.
+ * \param lda row stride of first matrix.
+ * \param mc number of rows of the block.
+ * \param kc number of columns of the block.
+ * \param mr panel height.
+ * \param dst packed buffer.
+ */
+static void mat_kernel_pack_a(const mat_elem_t* src, size_t lda, size_t mc,
+    size_t kc, size_t mr, mat_elem_t* dst)
+{
+  for(size_t ir = 0 ; ir < mc ; ir += mr)
+  {
+    size_t rows = mc - ir < mr ? mc - ir : mr;
+
+    for(size_t p = 0 ; p < kc ; p++)
+    {
+      size_t i = 0;
+
+      for(; i < rows ; i++)
+      {
+        *dst++ = src[(ir + i) * lda + p];
+      }
+      for(; i < mr ; i++)
+      {
+        *dst++ = 0;
+      }
+    }
+  }
+}
+
+/**
+ * \brief Packs a kc x nc block of second matrix in panels of nr columns.
+ *
+ * Each panel stores, for every k, the nr elements of its columns. Missing
+ * columns of the last panel are zero-padded.
+ * \param src first element of the block.
+ * \param ldb row stride of second matrix.
+ * \param kc number of rows of the block.
+ * \param nc number of columns of the block.
+ * \param nr panel width.
+ * \param dst packed buffer.
+ */
+static void mat_kernel_pack_b(const mat_elem_t* src, size_t ldb, size_t kc,
+    size_t nc, size_t nr, mat_elem_t* dst)
+{
+  for(size_t jr = 0 ; jr < nc ; jr += nr)
+  {
+    size_t cols = nc - jr < nr ? nc - jr : nr;
+
+    for(size_t p = 0 ; p < kc ; p++)
+    {
+      const mat_elem_t* row = &src[p * ldb + jr];
+      size_t j = 0;
+
+      for(; j < cols ; j++)
+      {
+        *dst++ = row[j];
+      }
+      for(; j < nr ; j++)
+      {
+        *dst++ = 0;
+      }
+    }
+  }
+}
+
+size_t mat_kernel_count(void)
+{
+  return sizeof(mat_kernels) / sizeof(mat_kernels[0]);
+}
+
+const struct mat_kernel* mat_kernel_get(size_t idx)
+{
+  return idx < mat_kernel_count() ? &mat_kernels[idx] : NULL;
+}
+
+int mat_kernel_supported(const struct mat_kernel* kernel)
+{
+  return kernel->supported ? kernel->supported() : 1;
+}
+
+const struct mat_kernel* mat_kernel_default(void)
+{
+  static const struct mat_kernel* kernel = NULL;
+
+  /* CPU does not change during the run, first detection is kept */
+  if(!kernel)
+  {
+    const char* name = getenv("MAT_KERNEL");
+    size_t i = 0;
+
+    /* MAT_KERNEL environment variable forces a kernel if CPU supports it */
+    if(name)
+    {
+      for(i = 0 ; i < mat_kernel_count() ; i++)
+      {
+        if(!strcmp(mat_kernels[i].name, name) &&
+            mat_kernel_supported(&mat_kernels[i]))
+        {
+          kernel = &mat_kernels[i];
+          return kernel;
+        }
+      }
+    }
+
+    i = 0;
+    while(!mat_kernel_supported(&mat_kernels[i]))
+    {
+      i++;
+    }
+
+    kernel = &mat_kernels[i];
+  }
+
+  return kernel;
+}
+
+void mat_kernel_naive(const mat_elem_t* restrict mat1,
+    const mat_elem_t* restrict mat2, mat_elem_t* restrict result, size_t m,
+    size_t n, size_t w, size_t first_row, size_t last_row)
+{
+  (void)m;
+
+  for(size_t i = first_row ; i < last_row ; i++)
+  {
+    for(size_t j = 0 ; j < n ; j++)
+    {
+      mat_elem_t tmp = 0;
+
+      for(size_t k = 0 ; k < w ; k++)
+      {
+        tmp += mat1[i * w + k] * mat2[k * n + j];
+      }
+
+      result[i * n + j] = tmp;
+    }
+  }
+}
+
+int mat_kernel_packed_with(const struct mat_kernel* kernel,
+    const mat_elem_t* restrict mat1, const mat_elem_t* restrict mat2,
+    mat_elem_t* restrict result, size_t m, size_t n, size_t w,
+    size_t first_row, size_t last_row)
+{
+  size_t mr = kernel->mr;
+  size_t nr = kernel->nr;
+  /* round blocks up to whole panels so that padding fits in buffers */
+  size_t mc_max = (MAT_KERNEL_MC + mr - 1) / mr * mr;
+  size_t nc_max = (MAT_KERNEL_NC + nr - 1) / nr * nr;
+  mat_elem_t* pack_a = NULL;
+  mat_elem_t* pack_b = NULL;
+
+  if(last_row > m)
+  {
+    last_row = m;
+  }
+
+  if(first_row >= last_row)
+  {
+    return 0;
+  }
+
+  pack_a = mat_alloc(mc_max * MAT_KERNEL_KC);
+  pack_b = mat_alloc(MAT_KERNEL_KC * nc_max);
+
+  if(!pack_a || !pack_b)
+  {
+    free(pack_a);
+    free(pack_b);
+    return -1;
+  }
+
+  memset(&result[first_row * n], 0x00,
+      (last_row - first_row) * n * sizeof(mat_elem_t));
+
+  for(size_t jc = 0 ; jc < n ; jc += MAT_KERNEL_NC)
+  {
+    size_t nc = n - jc < MAT_KERNEL_NC ? n - jc : MAT_KERNEL_NC;
+
+    for(size_t pc = 0 ; pc < w ; pc += MAT_KERNEL_KC)
+    {
+      size_t kc = w - pc < MAT_KERNEL_KC ? w - pc : MAT_KERNEL_KC;
+
+      mat_kernel_pack_b(&mat2[pc * n + jc], n, kc, nc, nr, pack_b);
+
+      for(size_t ic = first_row ; ic < last_row ; ic += MAT_KERNEL_MC)
+      {
+        size_t mc = last_row - ic < MAT_KERNEL_MC ? last_row - ic :
+          MAT_KERNEL_MC;
+
+        mat_kernel_pack_a(&mat1[ic * w + pc], w, mc, kc, mr, pack_a);
+
+        for(size_t jr = 0 ; jr < nc ; jr += nr)
+        {
+          size_t cols = nc - jr < nr ? nc - jr : nr;
+
+          for(size_t ir = 0 ; ir < mc ; ir += mr)
+          {
+            size_t rows = mc - ir < mr ? mc - ir : mr;
+
+            kernel->micro(kc, &pack_a[ir * kc], &pack_b[jr * kc],
+                &result[(ic + ir) * n + jc + jr], n, rows, cols);
+          }
+        }
+      }
+    }
+  }
+
+  free(pack_a);
+  free(pack_b);
+  return 0;
+}
+
+void mat_kernel_skinny(const mat_elem_t* restrict mat1,
+    const mat_elem_t* restrict mat2, mat_elem_t* restrict result, size_t m,
+    size_t n, size_t w, size_t first_row, size_t last_row)
+{
+  if(last_row > m)
+  {
+    last_row = m;
+  }
+
+  if(n == 1)
+  {
+    /* matrix-vector product: second matrix is a contiguous column */
+    for(size_t i = first_row ; i < last_row ; i++)
+    {
+      const mat_elem_t* a = &mat1[i * w];
+      mat_elem_t tmp = 0;
+
+      for(size_t k = 0 ; k < w ; k++)
+      {
+        tmp += a[k] * mat2[k];
+      }
+
+      result[i] = tmp;
+    }
+
+    return;
+  }
+
+  if(n <= MAT_KERNEL_SKINNY)
+  {
+    /* narrow result: four rows are accumulated in registers so that each
+     * row of second matrix is loaded once for all of them
+     */
+    size_t i = first_row;
+
+    for( ; i + 4 <= last_row ; i += 4)
+    {
+      mat_elem_t acc[4][MAT_KERNEL_SKINNY] = {{0}};
+
+      for(size_t k = 0 ; k < w ; k++)
+      {
+        const mat_elem_t* b = &mat2[k * n];
+        mat_elem_t a0 = mat1[i * w + k];
+        mat_elem_t a1 = mat1[(i + 1) * w + k];
+        mat_elem_t a2 = mat1[(i + 2) * w + k];
+        mat_elem_t a3 = mat1[(i + 3) * w + k];
+
+        for(size_t j = 0 ; j < n ; j++)
+        {
+          acc[0][j] += a0 * b[j];
+          acc[1][j] += a1 * b[j];
+          acc[2][j] += a2 * b[j];
+          acc[3][j] += a3 * b[j];
+        }
+      }
+
+      for(size_t r = 0 ; r < 4 ; r++)
+      {
+        memcpy(&result[(i + r) * n], acc[r], n * sizeof(mat_elem_t));
+      }
+    }
+
+    first_row = i;
+  }
+
+  /* second matrix stays in cache, result row is streamed once */
+  for(size_t i = first_row ; i < last_row ; i++)
+  {
+    const mat_elem_t* a = &mat1[i * w];
+    mat_elem_t* res = &result[i * n];
+
+    memset(res, 0x00, n * sizeof(mat_elem_t));
+
+    for(size_t k = 0 ; k < w ; k++)
+    {
+      const mat_elem_t* b = &mat2[k * n];
+      mat_elem_t av = a[k];
+
+      for(size_t j = 0 ; j < n ; j++)
+      {
+        res[j] += av * b[j];
+      }
+    }
+  }
+}
+
+int mat_kernel_packed(const mat_elem_t* restrict mat1,
+    const mat_elem_t* restrict mat2, mat_elem_t* restrict result, size_t m,
+    size_t n, size_t w, size_t first_row, size_t last_row)
+{
+  const struct mat_kernel* kernel = mat_kernel_default();
+
+  /* packing does not pay off when micro-kernels would mostly compute
+   * padding: narrow second matrix or fewer rows than a micro-kernel
+   */
+  if(n <= MAT_KERNEL_SKINNY ||
+      (last_row > first_row && last_row - first_row < kernel->mr))
+  {
+    mat_kernel_skinny(mat1, mat2, result, m, n, w, first_row, last_row);
+    return 0;
+  }
+
+  return mat_kernel_packed_with(kernel, mat1, mat2, result, m, n, w,
+      first_row, last_row);
+}
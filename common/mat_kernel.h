@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) 2026, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file mat_kernel.h
+ * \brief Packed matrix multiplication kernels shared by CPU backends.
+ * \author Sebastien Vincent
+ * \date 2026
+ */
+
+#ifndef VS_MAT_KERNEL_H
+#define VS_MAT_KERNEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mat_type.h"
+
+/**
+ * \def MAT_KERNEL_MC
+ * \brief Rows of first matrix packed per block (sized for L2 cache).
+ */
+#define MAT_KERNEL_MC 64
+
+/**
+ * \def MAT_KERNEL_KC
+ * \brief Common dimension elements packed per block (sized for L1 cache).
+ */
+#define MAT_KERNEL_KC 256
+
+/**
+ * \def MAT_KERNEL_NC
+ * \brief Columns of second matrix packed per block (sized for L3 cache).
+ */
+#define MAT_KERNEL_NC 1024
+
+/**
+ * \def MAT_KERNEL_SKINNY
+ * \brief Column size of second matrix up to which mat_kernel_packed() uses
+ * mat_kernel_skinny(). Vector integer multiplication is slow so packing
+ * integers pays off only for wider matrixes.
+ */
+#if MAT_ELEM_FLOATING
+#define MAT_KERNEL_SKINNY 2
+#else
+#define MAT_KERNEL_SKINNY 8
+#endif
+
+/**
+ * \struct mat_kernel
+ * \brief Register-blocked micro-kernel.
+ */
+struct mat_kernel
+{
+  /**
+   * \brief Name of the kernel.
+   */
+  const char* name;
+
+  /**
+   * \brief Number of rows computed by the micro-kernel.
+   */
+  size_t mr;
+
+  /**
+   * \brief Number of columns computed by the micro-kernel.
+   */
+  size_t nr;
+
+  /**
+   * \brief Checks if the kernel can run on current CPU (NULL if always).
+   * \return 1 if kernel is supported, 0 otherwise.
+   */
+  int (*supported)(void);
+
+  /**
+   * \brief Micro-kernel: adds the product of a packed mr x kc panel of first
+   * matrix and a packed kc x nr panel of second matrix to the rows x cols
+   * upper-left part of result block.
+   * \param kc common dimension size.
+   * \param a packed panel of first matrix.
+   * \param b packed panel of second matrix.
+   * \param c result block.
+   * \param ldc row stride of result.
+   * \param rows number of valid rows in result block.
+   * \param cols number of valid columns in result block.
+   */
+  void (*micro)(size_t kc, const mat_elem_t* a, const mat_elem_t* b,
+      mat_elem_t* c, size_t ldc, size_t rows, size_t cols);
+};
+
+/**
+ * \brief Returns number of micro-kernels available.
+ * \return number of micro-kernels.
+ */
+size_t mat_kernel_count(void);
+
+/**
+ * \brief Returns a micro-kernel.
+ * \param idx index of the kernel (lower than mat_kernel_count()).
+ * \return micro-kernel or NULL if idx is out of range.
+ */
+const struct mat_kernel* mat_kernel_get(size_t idx);
+
+/**
+ * \brief Checks if a micro-kernel can run on current CPU.
+ * \param kernel micro-kernel.
+ * \return 1 if kernel is supported, 0 otherwise.
+ */
+int mat_kernel_supported(const struct mat_kernel* kernel);
+
+/**
+ * \brief Returns the default micro-kernel, that is the fastest one supported
+ * by current CPU. MAT_KERNEL environment variable can force another supported
+ * kernel by its name.
+ * \return micro-kernel.
+ */
+const struct mat_kernel* mat_kernel_default(void);
+
+/**
+ * \brief Computes a range of rows of result with the naive i-j-k loop.
+ * \param mat1 first matrix (m x w).
+ * \param mat2 second matrix (w x n).
+ * \param result result matrix (m x n).
+ * \param m row size of first matrix.
+ * \param n column size of second matrix.
+ * \param w column size of first matrix.
+ * \param first_row first row of result to compute.
+ * \param last_row row after the last one to compute.
+ */
+void mat_kernel_naive(const mat_elem_t* restrict mat1,
+    const mat_elem_t* restrict mat2, mat_elem_t* restrict result, size_t m,
+    size_t n, size_t w, size_t first_row, size_t last_row);
+
+/**
+ * \brief Computes a range of rows of result by packing panels of both
+ * matrixes in aligned buffers and running a micro-kernel over them.
+ * \param kernel micro-kernel to use.
+ * \param mat1 first matrix (m x w).
+ * \param mat2 second matrix (w x n).
+ * \param result result matrix (m x n).
+ * \param m row size of first matrix.
+ * \param n column size of second matrix.
+ * \param w column size of first matrix.
+ * \param first_row first row of result to compute.
+ * \param last_row row after the last one to compute.
+ * \return 0 if success, -1 if packed buffers cannot be allocated.
+ */
+int mat_kernel_packed_with(const struct mat_kernel* kernel,
+    const mat_elem_t* restrict mat1, const mat_elem_t* restrict mat2,
+    mat_elem_t* restrict result, size_t m, size_t n, size_t w,
+    size_t first_row, size_t last_row);
+
+/**
+ * \brief Computes a range of rows of result for skinny shapes (few columns
+ * in second matrix or few rows in the range).
+ *
+ * Each row of result is accumulated with an i-k-j loop, second matrix is
+ * read with unit stride and stays in cache. Column vectors (n = 1) are
+ * computed as dot products.
+ * \param mat1 first matrix (m x w).
+ * \param mat2 second matrix (w x n).
+ * \param result result matrix (m x n).
+ * \param m row size of first matrix.
+ * \param n column size of second matrix.
+ * \param w column size of first matrix.
+ * \param first_row first row of result to compute.
+ * \param last_row row after the last one to compute.
+ */
+void mat_kernel_skinny(const mat_elem_t* restrict mat1,
+    const mat_elem_t* restrict mat2, mat_elem_t* restrict result, size_t m,
+    size_t n, size_t w, size_t first_row, size_t last_row);
+
+/**
+ * \brief Computes a range of rows of result with the default packed kernel,
+ * or with mat_kernel_skinny() for skinny shapes.
+ * \param mat1 first matrix (m x w).
+ * \param mat2 second matrix (w x n).
+ * \param result result matrix (m x n).
+ * \param m row size of first matrix.
+ * \param n column size of second matrix.
+ * \param w column size of first matrix.
+ * \param first_row first row of result to compute.
+ * \param last_row row after the last one to compute.
+ * \return 0 if success, -1 if packed buffers cannot be allocated.
+ */
+int mat_kernel_packed(const mat_elem_t* restrict mat1,
+    const mat_elem_t* restrict mat2, mat_elem_t* restrict result, size_t m,
+    size_t n, size_t w, size_t first_row, size_t last_row);
+
+#endif /* VS_MAT_KERNEL_H */
@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2026, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file mat_transpose.h
+ * \brief Transposition of second matrix so that products read both matrixes
+ * with unit stride.
+ * \author Sebastien Vincent
+ * \date 2026
+ *
+ * Transposition is timed and reported apart from multiplication: it is paid
+ * once when the same second matrix is used for several multiplications.
+ *
+ * Functions are inline so that backends that do not link the shared kernels
+ * (MPI) can use them.
+ */
+
+#ifndef VS_MAT_TRANSPOSE_H
+#define VS_MAT_TRANSPOSE_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "mat_type.h"
+
+/**
+ * \def MAT_TRANSPOSE_BLOCK
+ * \brief Side of square blocks copied by mat_transpose(), a block of source
+ * and one of destination fit in L1 cache.
+ */
+#define MAT_TRANSPOSE_BLOCK 32
+
+/**
+ * \brief Transposes a range of rows of a matrix block by block, so that the
+ * strided writes stay in cache. Threads can transpose separate ranges of rows
+ * in parallel.
+ * \param src source matrix (rows x cols).
+ * \param dst destination matrix (cols x rows).
+ * \param rows row size of source.
+ * \param cols column size of source.
+ * \param first_row first row of source to transpose.
+ * \param last_row row after the last one to transpose.
+ */
+static inline void mat_transpose(const mat_elem_t* restrict src,
+    mat_elem_t* restrict dst, size_t rows, size_t cols, size_t first_row,
+    size_t last_row)
+{
+  for(size_t ii = first_row ; ii < last_row ; ii += MAT_TRANSPOSE_BLOCK)
+  {
+    size_t i_end = ii + MAT_TRANSPOSE_BLOCK < last_row ?
+      ii + MAT_TRANSPOSE_BLOCK : last_row;
+
+    for(size_t jj = 0 ; jj < cols ; jj += MAT_TRANSPOSE_BLOCK)
+    {
+      size_t j_end = jj + MAT_TRANSPOSE_BLOCK < cols ?
+        jj + MAT_TRANSPOSE_BLOCK : cols;
+
+      for(size_t i = ii ; i < i_end ; i++)
+      {
+        for(size_t j = jj ; j < j_end ; j++)
+        {
+          dst[j * rows + i] = src[i * cols + j];
+        }
+      }
+    }
+  }
+}
+
+/**
+ * \brief Returns the dot product of a row of first matrix and a row of
+ * transposed second matrix. The sum is a SIMD reduction, so floating-point
+ * results may differ from the i-j-k loop in the last bits.
+ * \param a row of first matrix.
+ * \param bt row of transposed second matrix.
+ * \param w number of elements.
+ * \return dot product.
+ */
+static inline mat_elem_t mat_dot(const mat_elem_t* restrict a,
+    const mat_elem_t* restrict bt, size_t w)
+{
+  mat_elem_t tmp = 0;
+
+  #pragma omp simd reduction(+:tmp)
+  for(size_t k = 0 ; k < w ; k++)
+  {
+    tmp += a[k] * bt[k];
+  }
+
+  return tmp;
+}
+
+/**
+ * \brief Function that transposes second matrix (w x n) in mat2t (n x w),
+ * arg being specific to the backend (i.e. its threads).
+ */
+typedef void (*mat_transpose_func)(const mat_elem_t* restrict mat2,
+    mat_elem_t* restrict mat2t, size_t n, size_t w, void* arg);
+
+/**
+ * \brief Allocates transposed second matrix, fills it and prints the time
+ * spent in transposition.
+ * \param mat2 second matrix (w x n).
+ * \param n column size of second matrix.
+ * \param w row size of second matrix.
+ * \param func transposition function, NULL for mat_transpose() of all rows.
+ * \param arg argument of func.
+ * \return transposed second matrix (n x w) or NULL if allocation fails.
+ */
+static inline mat_elem_t* mat_transpose_timed(const mat_elem_t* mat2,
+    size_t n, size_t w, mat_transpose_func func, void* arg)
+{
+  mat_elem_t* mat2t = mat_alloc(w * n);
+  struct timespec start;
+  struct timespec end;
+
+  if(!mat2t)
+  {
+    return NULL;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  if(func)
+  {
+    func(mat2, mat2t, n, w, arg);
+  }
+  else
+  {
+    mat_transpose(mat2, mat2t, w, n, 0, w);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  fprintf(stdout, "Transpose: %f ms\n",
+      (end.tv_sec - start.tv_sec) * 1000.0 +
+      (end.tv_nsec - start.tv_nsec) / 1000000.0);
+  return mat2t;
+}
+
+#endif /* VS_MAT_TRANSPOSE_H */
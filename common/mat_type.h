@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2026, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file mat_type.h
+ * \brief Element type of matrixes, selected at compile time.
+ * \author Sebastien Vincent
+ * \date 2026
+ *
+ * Define MAT_TYPE to one of MAT_UINT64 (default), MAT_INT64, MAT_INT32,
+ * MAT_DOUBLE or MAT_FLOAT when compiling (i.e. -DMAT_TYPE=MAT_DOUBLE).
+ */
+
+#ifndef VS_MAT_TYPE_H
+#define VS_MAT_TYPE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+/**
+ * \def MAT_UINT64
+ * \brief Unsigned 64-bit integer elements (arithmetic modulo 2^64).
+ */
+#define MAT_UINT64 1
+
+/**
+ * \def MAT_INT64
+ * \brief Signed 64-bit integer elements.
+ */
+#define MAT_INT64 2
+
+/**
+ * \def MAT_INT32
+ * \brief Signed 32-bit integer elements.
+ */
+#define MAT_INT32 3
+
+/**
+ * \def MAT_DOUBLE
+ * \brief Double precision floating-point elements.
+ */
+#define MAT_DOUBLE 4
+
+/**
+ * \def MAT_FLOAT
+ * \brief Single precision floating-point elements.
+ */
+#define MAT_FLOAT 5
+
+#ifndef MAT_TYPE
+/**
+ * \def MAT_TYPE
+ * \brief Element type of matrixes.
+ */
+#define MAT_TYPE MAT_UINT64
+#endif
+
+/*
+ * For each type:
+ * - mat_elem_t: C type;
+ * - MAT_ELEM_NAME: name of the type;
+ * - MAT_ELEM_FMT: printf format;
+ * - MAT_ELEM_MPI: MPI datatype;
+ * - MAT_ELEM_CL: OpenCL C type;
+ * - MAT_ELEM_FLOATING: 1 for floating-point types, 0 otherwise;
+ * - MAT_ELEM_INIT(i): value of i-th element of initialized matrixes. Signed
+ *   types use small values so that products and sums do not overflow.
+ */
+#if MAT_TYPE == MAT_UINT64
+typedef uint64_t mat_elem_t;
+#define MAT_ELEM_NAME "uint64"
+#define MAT_ELEM_FMT "%" PRIu64
+#define MAT_ELEM_MPI MPI_UINT64_T
+#define MAT_ELEM_CL "ulong"
+#define MAT_ELEM_FLOATING 0
+#define MAT_ELEM_INIT(i) ((mat_elem_t)(i))
+#elif MAT_TYPE == MAT_INT64
+typedef int64_t mat_elem_t;
+#define MAT_ELEM_NAME "int64"
+#define MAT_ELEM_FMT "%" PRId64
+#define MAT_ELEM_MPI MPI_INT64_T
+#define MAT_ELEM_CL "long"
+#define MAT_ELEM_FLOATING 0
+#define MAT_ELEM_INIT(i) ((mat_elem_t)((i) % 65536))
+#elif MAT_TYPE == MAT_INT32
+typedef int32_t mat_elem_t;
+#define MAT_ELEM_NAME "int32"
+#define MAT_ELEM_FMT "%" PRId32
+#define MAT_ELEM_MPI MPI_INT32_T
+#define MAT_ELEM_CL "int"
+#define MAT_ELEM_FLOATING 0
+#define MAT_ELEM_INIT(i) ((mat_elem_t)((i) % 256))
+#elif MAT_TYPE == MAT_DOUBLE
+typedef double mat_elem_t;
+#define MAT_ELEM_NAME "double"
+#define MAT_ELEM_FMT "%g"
+#define MAT_ELEM_MPI MPI_DOUBLE
+#define MAT_ELEM_CL "double"
+#define MAT_ELEM_FLOATING 1
+#define MAT_ELEM_INIT(i) ((mat_elem_t)(i))
+#elif MAT_TYPE == MAT_FLOAT
+typedef float mat_elem_t;
+#define MAT_ELEM_NAME "float"
+#define MAT_ELEM_FMT "%g"
+#define MAT_ELEM_MPI MPI_FLOAT
+#define MAT_ELEM_CL "float"
+#define MAT_ELEM_FLOATING 1
+#define MAT_ELEM_INIT(i) ((mat_elem_t)(i))
+#else
+#error "Unknown MAT_TYPE"
+#endif
+
+/**
+ * \def MAT_ALIGN
+ * \brief Alignment in bytes of matrixes (a cache line, and a whole AVX-512
+ * vector).
+ */
+#define MAT_ALIGN 64
+
+/**
+ * \brief Allocates a matrix aligned on MAT_ALIGN bytes. It is freed with
+ * free().
+ * \param nb number of elements.
+ * \return matrix or NULL if allocation fails.
+ */
+static inline mat_elem_t* mat_alloc(size_t nb)
+{
+  size_t size = nb * sizeof(mat_elem_t);
+
+  /* aligned_alloc requires size to be a multiple of alignment */
+  size = (size + MAT_ALIGN - 1) & ~((size_t)MAT_ALIGN - 1);
+  return aligned_alloc(MAT_ALIGN, size);
+}
+
+#endif /* VS_MAT_TYPE_H */
@@ -0,0 +1,398 @@
+/*
+ * Copyright (c) 2026, Sebastien Vincent
+ *
+ * Distributed under the terms of the BSD 3-clause License.
+ * See the LICENSE file for details.
+ */
+
+/**
+ * \file matmult-bench.c
+ * \brief Benchmark of the shared matrix multiplication kernels.
+ * \author Sebastien Vincent
+ * \date 2026
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+#include <time.h>
+#include <math.h>
+
+#include <sys/time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "mat_kernel.h"
+
+/**
+ * \brief Default row size.
+ */
+static const size_t DEFAULT_ROW_SIZE = 512;
+
+/**
+ * \brief Default number of runs per kernel.
+ */
+static const size_t DEFAULT_RUNS = 3;
+
+/**
+ * \struct configuration
+ * \brief Configuration.
+ */
+struct configuration
+{
+  /**
+   * \brief Row size of first matrix.
+   */
+  size_t m;
+
+  /**
+   * \brief Column size of second matrix.
+   */
+  size_t n;
+
+  /**
+   * \brief Common dimension (column size of first matrix).
+   */
+  size_t w;
+
+  /**
+   * \brief Number of runs per kernel (best one is reported).
+   */
+  size_t runs;
+};
+
+/**
+ * \brief Get time in microseconds.
+ * \return time in microseconds.
+ */
+static double util_gettime_us(void)
+{
+    struct timeval t;
+    gettimeofday(&t, NULL);
+    return t.tv_sec * 1000000 + t.tv_usec;
+}
+
+/**
+ * \brief Get cycle counter.
+ *
+ * Time stamp counter is used on x86, it counts reference cycles which match
+ * core cycles when frequency scaling is disabled. Nanoseconds are returned
+ * on other architectures.
+ * \return cycle counter.
+ */
+static uint64_t util_getcycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+#endif
+}
+
+/**
+ * \brief Initializes the matrixes.
+ * \param mat1 first matrix.
+ * \param mat2 second matrix.
+ * \param m row size of first matrix.
+ * \param n column size of second matrix.
+ * \param w column size of first matrix.
+ */
+void mat_init(mat_elem_t* mat1, mat_elem_t* mat2, size_t m, size_t n,
+    size_t w)
+{
+  for(size_t i = 0 ; i < (m * w) ; i++)
+  {
+    mat1[i] = MAT_ELEM_INIT(i);
+  }
+
+  for(size_t i = 0 ; i < (w * n) ; i++)
+  {
+    mat2[i] = MAT_ELEM_INIT(i);
+  }
+}
+
+/**
+ * \brief Compares two matrixes.
+ *
+ * Integer results must be identical, floating-point ones may differ by
+ * rounding since kernels do not sum in the same order.
+ * \param ref reference matrix.
+ * \param mat matrix to check.
+ * \param nb number of elements.
+ * \return 0 if matrixes match, -1 otherwise.
+ */
+int mat_compare(const mat_elem_t* ref, const mat_elem_t* mat, size_t nb)
+{
+#if MAT_ELEM_FLOATING
+  for(size_t i = 0 ; i < nb ; i++)
+  {
+    double diff = fabs((double)ref[i] - (double)mat[i]);
+
+    if(diff > 1e-4 * fabs((double)ref[i]) + 1e-6)
+    {
+      return -1;
+    }
+  }
+
+  return 0;
+#else
+  return memcmp(ref, mat, nb * sizeof(mat_elem_t)) ? -1 : 0;
+#endif
+}
+
+/**
+ * \brief Print help.
+ * \param program program name.
+ */
+void print_help(const char* program)
+{
+  fprintf(stdout, "Usage: %s [-m size] [-M rows] [-K common] [-N columns] "
+      "[-r runs] [-h]\n\n"
+      "  -h\t\tDisplay this help\n"
+      "  -m size\tSize of square matrixes (default 512)\n"
+      "  -M rows\tRow size of first matrix (default -m)\n"
+      "  -K common\tColumn size of first matrix (default -m)\n"
+      "  -N columns\tColumn size of second matrix (default -m)\n"
+      "  -r runs\tNumber of runs per kernel (default 3)\n", program);
+}
+
+/**
+ * \brief Parse command line.
+ * \param argc number of arguments.
+ * \param argv array of arguments.
+ * \param configuration configuration parameters.
+ * \return 0 to exit with success, -1 to exit with error, otherwise continue.
+ */
+int parse_cmdline(int argc, char** argv,
+    struct configuration* configuration)
+{
+  /*
+   * h: print help and exit
+   * m: square size
+   * M: row size of first matrix
+   * K: common dimension
+   * N: column size of second matrix
+   * r: number of runs
+   */
+  static const char* options = "hm:M:K:N:r:";
+  int opt = 0;
+  long m = DEFAULT_ROW_SIZE;
+  long dims[3] = {0, 0, 0};
+  long runs = DEFAULT_RUNS;
+  int ret = 1;
+
+  assert(configuration);
+
+  while((opt = getopt(argc, argv, options)) != -1)
+  {
+    switch(opt)
+    {
+      case 'h':
+        /* help */
+        print_help(argv[0]);
+        return 0;
+        break;
+      case 'm':
+        m = atol(optarg);
+        if(m < 2)
+        {
+          fprintf(stderr, "Bad argument for '-m' %ld\n", m);
+          ret = -1;
+        }
+        break;
+      case 'M':
+      case 'K':
+      case 'N':
+        dims[opt == 'M' ? 0 : opt == 'K' ? 1 : 2] = atol(optarg);
+        if(atol(optarg) < 1)
+        {
+          fprintf(stderr, "Bad argument for '-%c': %s\n", opt, optarg);
+          ret = -1;
+        }
+        break;
+      case 'r':
+        runs = atol(optarg);
+        if(runs <= 0)
+        {
+          fprintf(stderr, "Bad argument for '-r': %s\n", optarg);
+          ret = -1;
+        }
+        break;
+      default:
+        fprintf(stderr, "Bad option (%c)\n", optopt);
+        ret = -1;
+        break;
+    }
+  }
+
+  configuration->m = dims[0] ? (size_t)dims[0] : (size_t)m;
+  configuration->w = dims[1] ? (size_t)dims[1] : (size_t)m;
+  configuration->n = dims[2] ? (size_t)dims[2] : (size_t)m;
+  configuration->runs = runs;
+
+  return ret;
+}
+
+/**
+ * \brief Entry point of the program.
+ * \param argc number of arguments.
+ * \param argv array of arguments.
+ * \return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+int main(int argc, char** argv)
+{
+  mat_elem_t* mat1 = NULL;
+  mat_elem_t* mat2 = NULL;
+  mat_elem_t* ref = NULL;
+  mat_elem_t* mat3 = NULL;
+  size_t m = DEFAULT_ROW_SIZE;
+  size_t n = DEFAULT_ROW_SIZE;
+  size_t w = DEFAULT_ROW_SIZE;
+  struct configuration config;
+  size_t nb_elements = 0;
+  size_t nb_kernels = mat_kernel_count();
+  double ops = 0;
+  double naive_ops_cycle = 0;
+  int ret = 0;
+
+  ret = parse_cmdline(argc, argv, &config);
+
+  if(ret == 0)
+  {
+    exit(EXIT_SUCCESS);
+  }
+  else if(ret == -1)
+  {
+    exit(EXIT_FAILURE);
+  }
+
+  ret = EXIT_SUCCESS;
+  m = config.m;
+  n = config.n;
+  w = config.w;
+  nb_elements = m * n;
+  /* one multiply and one add per inner iteration */
+  ops = 2.0 * m * n * w;
+
+  mat1 = malloc(m * w * sizeof(mat_elem_t));
+  mat2 = malloc(w * n * sizeof(mat_elem_t));
+  ref = malloc(nb_elements * sizeof(mat_elem_t));
+  mat3 = malloc(nb_elements * sizeof(mat_elem_t));
+
+  if(!mat1 || !mat2 || !ref || !mat3)
+  {
+    perror("malloc");
+    free(mat1);
+    free(mat2);
+    free(ref);
+    free(mat3);
+    exit(EXIT_FAILURE);
+  }
+
+  mat_init(mat1, mat2, m, n, w);
+
+  fprintf(stdout, "Element type: %s\n", MAT_ELEM_NAME);
+  fprintf(stdout, "Shape: %zux%zu * %zux%zu\n", m, w, w, n);
+  fprintf(stdout, "%-16s %12s %14s %10s\n", "kernel", "time (ms)",
+      "ops/cycle", "speedup");
+
+  /*
+   * naive loop is the reference for both speed and result, it is followed by
+   * packed micro-kernels and the skinny kernel
+   */
+  for(size_t kidx = 0 ; kidx <= nb_kernels + 1 ; kidx++)
+  {
+    const struct mat_kernel* kernel = kidx ? mat_kernel_get(kidx - 1) : NULL;
+    int skinny = kidx > nb_kernels;
+    mat_elem_t* res = kidx ? mat3 : ref;
+    uint64_t best_cycles = UINT64_MAX;
+    double best_time = 0;
+    double ops_cycle = 0;
+    char name[64];
+
+    if(kernel && !mat_kernel_supported(kernel))
+    {
+      fprintf(stdout, "packed-%-9s not supported by this CPU\n", kernel->name);
+      continue;
+    }
+
+    for(size_t r = 0 ; r < config.runs ; r++)
+    {
+      double start = util_gettime_us();
+      uint64_t cycles = util_getcycles();
+
+      if(kernel)
+      {
+        if(mat_kernel_packed_with(kernel, mat1, mat2, res, m, n, w, 0, m) != 0)
+        {
+          fprintf(stderr, "Kernel %s failed\n", kernel->name);
+          ret = EXIT_FAILURE;
+          break;
+        }
+      }
+      else if(skinny)
+      {
+        mat_kernel_skinny(mat1, mat2, res, m, n, w, 0, m);
+      }
+      else
+      {
+        mat_kernel_naive(mat1, mat2, res, m, n, w, 0, m);
+      }
+
+      cycles = util_getcycles() - cycles;
+
+      if(cycles < best_cycles)
+      {
+        best_cycles = cycles;
+        best_time = (util_gettime_us() - start) / 1000;
+      }
+    }
+
+    if(kidx)
+    {
+      if(kernel)
+      {
+        snprintf(name, sizeof(name), "packed-%s", kernel->name);
+      }
+      else
+      {
+        snprintf(name, sizeof(name), "skinny");
+      }
+
+      if(mat_compare(ref, mat3, nb_elements) != 0)
+      {
+        fprintf(stderr, "Kernel %s gives a wrong result\n", name);
+        ret = EXIT_FAILURE;
+      }
+    }
+    else
+    {
+      snprintf(name, sizeof(name), "naive");
+    }
+
+    ops_cycle = ops / best_cycles;
+
+    if(!kidx)
+    {
+      naive_ops_cycle = ops_cycle;
+    }
+
+    fprintf(stdout, "%-16s %12.3f %14.3f %9.2fx\n", name, best_time,
+        ops_cycle, ops_cycle / naive_ops_cycle);
+  }
+
+  /* free resources */
+  free(mat1);
+  free(mat2);
+  free(ref);
+  free(mat3);
+
+  return ret;
+}
@@ -15,6 +15,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <limits.h>
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
@@ -29,15 +30,131 @@
 #include <omp.h>
 #endif
 
+#include "mat_type.h"
+#include "mat_transpose.h"
+
 /**
  * \brief Default row size.
  */
 static const size_t DEFAULT_ROW_SIZE = 1024;
 
 /**
- * \brief Default column size.
+ * \brief Default width of panels broadcast by rows and SUMMA algorithms.
+ */
+static const size_t DEFAULT_PANEL_SIZE = 256;
+
+/**
+ * \brief Number of rows computed between two calls that let MPI progress
+ * communications in flight.
+ */
+static const size_t PROGRESS_ROWS = 64;
+
+/**
+ * \brief Default number of layers of 2.5D algorithm.
+ */
+static const size_t DEFAULT_LAYERS = 2;
+
+/**
+ * \enum mat_algorithm
+ * \brief Distributed multiplication algorithm.
+ */
+enum mat_algorithm
+{
+  MAT_ROWS = 0, /**< Rows of first matrix scattered, second one broadcast. */
+  MAT_SUMMA, /**< SUMMA on a 2D grid of blocks. */
+  MAT_CANNON, /**< Cannon on a square periodic grid of blocks. */
+  MAT_25D, /**< SUMMA replicated on layers of a 3D grid (2.5D). */
+  MAT_RMA /**< Rows of first matrix, panels of second one read remotely. */
+};
+
+/**
+ * \struct mat_grid
+ * \brief 3D grid of processes: layers of 2D grids. Block (i, j) of a matrix
+ * is made of the i-th range of rows and the j-th range of columns (see
+ * mat_range()), each layer has a copy of all blocks.
+ */
+struct mat_grid
+{
+  /**
+   * \brief Cartesian communicator.
+   */
+  MPI_Comm comm;
+
+  /**
+   * \brief Processes of the same layer (2D cartesian communicator).
+   */
+  MPI_Comm layer_comm;
+
+  /**
+   * \brief Processes with the same block in each layer, rank is the layer.
+   */
+  MPI_Comm depth_comm;
+
+  /**
+   * \brief Processes of the same grid row, rank is the column coordinate.
+   */
+  MPI_Comm row_comm;
+
+  /**
+   * \brief Processes of the same grid column, rank is the row coordinate.
+   */
+  MPI_Comm col_comm;
+
+  /**
+   * \brief Number of grid rows, columns and layers.
+   */
+  int dims[3];
+
+  /**
+   * \brief Coordinates of this process.
+   */
+  int coords[3];
+};
+
+/**
+ * \struct mat_node
+ * \brief Processes of a shared memory node. Node leader (rank 0 of node)
+ * allocates a shared memory window that other processes of the node read
+ * directly.
  */
-static const size_t DEFAULT_COLUMN_SIZE = 1024;
+struct mat_node
+{
+  /**
+   * \brief Processes of the node.
+   */
+  MPI_Comm comm;
+
+  /**
+   * \brief Leaders of all nodes (MPI_COMM_NULL on other processes), rank is
+   * the node index.
+   */
+  MPI_Comm leaders;
+
+  /**
+   * \brief Rank in node.
+   */
+  int rank;
+
+  /**
+   * \brief Index of node.
+   */
+  int id;
+
+  /**
+   * \brief Number of nodes.
+   */
+  int count;
+
+  /**
+   * \brief Shared memory window.
+   */
+  MPI_Win win;
+
+  /**
+   * \brief Base of shared memory of the node.
+   */
+  mat_elem_t* base;
+};
 
 /**
  * \struct configuration
@@ -46,210 +163,2186 @@ static const size_t DEFAULT_COLUMN_SIZE = 1024;
 struct configuration
 {
   /**
-   * \brief Row/column size.
+   * \brief Row size of first matrix.
    */
   size_t m;
 
+  /**
+   * \brief Column size of second matrix.
+   */
+  size_t n;
+
+  /**
+   * \brief Common dimension (column size of first matrix).
+   */
+  size_t w;
+
   /**
    * \brief Print input and output matrixes.
    */
   int print_matrix;
 
+  /**
+   * \brief Gather result on rank 0.
+   */
+  int gather;
+
   /**
    * \brief Number of threads.
    */
   size_t threads;
+
+  /**
+   * \brief Transpose second matrix before broadcasting it.
+   */
+  int transpose;
+
+  /**
+   * \brief Distributed algorithm.
+   */
+  enum mat_algorithm algorithm;
+
+  /**
+   * \brief Width of panels broadcast by rows and SUMMA algorithms.
+   */
+  size_t panel;
+
+  /**
+   * \brief Share second matrix between processes of a node.
+   */
+  int shared;
+
+  /**
+   * \brief Number of layers of 2.5D algorithm.
+   */
+  size_t layers;
+
+  /**
+   * \brief Binary file of first matrix (NULL to initialize it).
+   */
+  const char* file1;
+
+  /**
+   * \brief Binary file of second matrix (NULL to initialize it).
+   */
+  const char* file2;
+
+  /**
+   * \brief Binary file to store result in (NULL not to store it).
+   */
+  const char* result_file;
 };
 
-/**
- * \brief Initializes the matrixes.
- * \param mat1 first matrix.
- * \param mat2 second matrix.
- * \param m row size of the matrix.
- * \param n column size of the matrix.
- */
-void mat_init(uint64_t* mat1, uint64_t* mat2, size_t m, size_t n)
-{
-  for(size_t i = 0 ; i < (m * n) ; i++)
+/**
+ * \brief Initializes the matrixes.
+ * \param mat1 first matrix.
+ * \param mat2 second matrix.
+ * \param m row size of first matrix.
+ * \param n column size of second matrix.
+ * \param w column size of first matrix.
+ */
+void mat_init(mat_elem_t* mat1, mat_elem_t* mat2, size_t m, size_t n,
+    size_t w)
+{
+  for(size_t i = 0 ; i < (m * w) ; i++)
+  {
+    mat1[i] = MAT_ELEM_INIT(i);
+  }
+
+  for(size_t i = 0 ; i < (w * n) ; i++)
+  {
+    mat2[i] = MAT_ELEM_INIT(i);
+  }
+}
+
+/**
+ * \brief Print the matrix content on stdout.
+ * \param mat the matrix.
+ * \param m row size of the matrix.
+ * \param n column size of the matrix.
+ */
+void mat_print(mat_elem_t* mat, size_t m, size_t n)
+{
+  for(size_t i = 0 ; i < m ; i++)
+  {
+    for(size_t j = 0 ; j < n ; j++)
+    {
+      fprintf(stdout, MAT_ELEM_FMT " ", mat[i * n + j]);
+    }
+    fprintf(stdout, "\n");
+  }
+}
+
+/**
+ * \brief Computes rows of result, rows are shared out to OpenMP threads with
+ * a single worksharing loop.
+ *
+ * The i-k-j order reads rows of second matrix and result with unit stride in
+ * the vectorized loop, each element still sums its products in k order.
+ * \param mat1 rows of first matrix.
+ * \param mat2 second matrix.
+ * \param res rows of result matrix.
+ * \param rows number of rows.
+ * \param n column size of second matrix.
+ * \param w column size of first matrix.
+ * \param ldb distance between rows of second matrix (n unless it is a
+ * column panel of a wider matrix).
+ * \param ldc distance between rows of result (n unless it is a column panel
+ * of a wider matrix).
+ * \param threads number of threads to use (OpenMP only).
+ * \param accumulate add products to result instead of overwriting it.
+ */
+static void mat_mult_rows(const mat_elem_t* restrict mat1,
+    const mat_elem_t* restrict mat2, mat_elem_t* restrict res, size_t rows,
+    size_t n, size_t w, size_t ldb, size_t ldc, size_t threads,
+    int accumulate)
+{
+  (void)threads;
+
+#if _OPENMP
+  /* to set spread way, add to next line: proc_bind(spread) */
+  #pragma omp parallel for num_threads(threads) schedule(static)
+#endif
+  for(size_t i = 0 ; i < rows ; i++)
+  {
+    mat_elem_t* restrict r = &res[i * ldc];
+
+    if(!accumulate)
+    {
+      #pragma omp simd
+      for(size_t j = 0 ; j < n ; j++)
+      {
+        r[j] = 0;
+      }
+    }
+
+    for(size_t k = 0 ; k < w ; k++)
+    {
+      mat_elem_t av = mat1[i * w + k];
+      const mat_elem_t* restrict bk = &mat2[k * ldb];
+
+      #pragma omp simd
+      for(size_t j = 0 ; j < n ; j++)
+      {
+        r[j] += av * bk[j];
+      }
+    }
+  }
+}
+
+/**
+ * \brief Computes rows of result with transposed second matrix, each element
+ * is a dot product of two contiguous rows.
+ * \param mat1 rows of first matrix.
+ * \param mat2t transposed second matrix (n x w).
+ * \param res rows of result matrix.
+ * \param rows number of rows.
+ * \param n column size of second matrix.
+ * \param w column size of first matrix.
+ * \param ld distance between rows of result (n unless it is a column panel
+ * of a wider matrix).
+ * \param threads number of threads to use (OpenMP only).
+ */
+static void mat_mult_rows_transposed(const mat_elem_t* restrict mat1,
+    const mat_elem_t* restrict mat2t, mat_elem_t* restrict res, size_t rows,
+    size_t n, size_t w, size_t ld, size_t threads)
+{
+  (void)threads;
+
+#if _OPENMP
+  #pragma omp parallel for num_threads(threads) schedule(static)
+#endif
+  for(size_t i = 0 ; i < rows ; i++)
+  {
+    for(size_t j = 0 ; j < n ; j++)
+    {
+      res[i * ld + j] = mat_dot(&mat1[i * w], &mat2t[j * w], w);
+    }
+  }
+}
+
+/**
+ * \brief Transposes second matrix, blocks of rows are shared out to OpenMP
+ * threads.
+ * \param mat2 second matrix (w x n).
+ * \param mat2t transposed second matrix (n x w).
+ * \param n column size of second matrix.
+ * \param w row size of second matrix.
+ * \param threads number of threads to use (OpenMP only).
+ */
+void mat_transpose_mpi(const mat_elem_t* restrict mat2,
+    mat_elem_t* restrict mat2t, size_t n, size_t w, size_t threads)
+{
+  size_t blocks = (w + MAT_TRANSPOSE_BLOCK - 1) / MAT_TRANSPOSE_BLOCK;
+
+  (void)threads;
+
+#if _OPENMP
+  #pragma omp parallel for num_threads(threads) schedule(static)
+#endif
+  for(size_t bi = 0 ; bi < blocks ; bi++)
+  {
+    size_t first_row = bi * MAT_TRANSPOSE_BLOCK;
+    size_t last_row = first_row + MAT_TRANSPOSE_BLOCK < w ?
+      first_row + MAT_TRANSPOSE_BLOCK : w;
+
+    mat_transpose(mat2, mat2t, w, n, first_row, last_row);
+  }
+}
+
+/**
+ * \brief Splits rows of result between ranks in proportion to their weight
+ * (number of threads), so that heterogeneous nodes get a fair share. Rank r
+ * starts at row m * (weights of ranks before r) / (total weight).
+ * \param m row size of first matrix.
+ * \param weights weight of each rank.
+ * \param world_size Total number of MPI nodes.
+ * \param counts number of rows of each rank (world_size elements).
+ * \param displs first row of each rank (world_size elements).
+ */
+void mat_split_rows(size_t m, const int* weights, size_t world_size,
+    int* counts, int* displs)
+{
+  size_t total = 0;
+  size_t sum = 0;
+
+  for(size_t r = 0 ; r < world_size ; r++)
+  {
+    total += weights[r];
+  }
+
+  for(size_t r = 0 ; r < world_size ; r++)
+  {
+    size_t first_row = m * sum / total;
+
+    sum += weights[r];
+    displs[r] = first_row;
+    counts[r] = m * sum / total - first_row;
+  }
+}
+
+/**
+ * \brief Groups processes by shared memory node.
+ * \param node node to initialize.
+ */
+void mat_node_init(struct mat_node* node)
+{
+  int world_rank = 0;
+
+  MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
+  MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, world_rank,
+      MPI_INFO_NULL, &node->comm);
+  MPI_Comm_rank(node->comm, &node->rank);
+  MPI_Comm_split(MPI_COMM_WORLD, node->rank == 0 ? 0 : MPI_UNDEFINED,
+      world_rank, &node->leaders);
+
+  if(node->rank == 0)
+  {
+    MPI_Comm_rank(node->leaders, &node->id);
+    MPI_Comm_size(node->leaders, &node->count);
+  }
+
+  MPI_Bcast(&node->id, 1, MPI_INT, 0, node->comm);
+  MPI_Bcast(&node->count, 1, MPI_INT, 0, node->comm);
+}
+
+/**
+ * \brief Allocates the shared memory of a node.
+ * \param node node.
+ * \param nb number of elements of shared memory (used on leader only).
+ * \return 0 if success, -1 otherwise.
+ */
+int mat_node_alloc(struct mat_node* node, size_t nb)
+{
+  int disp_unit = 0;
+  MPI_Aint size = 0;
+
+  /* only leader allocates, others map its memory */
+  if(MPI_Win_allocate_shared(node->rank == 0 ? nb * sizeof(mat_elem_t) : 0,
+        sizeof(mat_elem_t), MPI_INFO_NULL, node->comm, &node->base,
+        &node->win) != MPI_SUCCESS)
+  {
+    return -1;
+  }
+
+  MPI_Win_shared_query(node->win, 0, &size, &disp_unit, &node->base);
+  MPI_Win_lock_all(MPI_MODE_NOCHECK, node->win);
+  return 0;
+}
+
+/**
+ * \brief Frees shared memory (see mat_node_alloc()) and communicators of a
+ * node.
+ * \param node node.
+ */
+void mat_node_destroy(struct mat_node* node)
+{
+  MPI_Win_unlock_all(node->win);
+  MPI_Win_free(&node->win);
+
+  if(node->leaders != MPI_COMM_NULL)
+  {
+    MPI_Comm_free(&node->leaders);
+  }
+  MPI_Comm_free(&node->comm);
+}
+
+/**
+ * \brief Makes writes of a process to shared memory of node visible to the
+ * others, all processes of the node wait for each other.
+ * \param node node.
+ */
+static void mat_node_sync(const struct mat_node* node)
+{
+  MPI_Win_sync(node->win);
+  MPI_Barrier(node->comm);
+  MPI_Win_sync(node->win);
+}
+
+/**
+ * \brief Initializes the rows of first matrix owned by a rank with the
+ * values mat_init() gives to the whole matrix.
+ * \param mat1 rows of first matrix.
+ * \param first_row first row.
+ * \param rows number of rows.
+ * \param w column size of first matrix.
+ */
+void mat_init_rows(mat_elem_t* mat1, size_t first_row, size_t rows,
+    size_t w)
+{
+  for(size_t i = 0 ; i < rows * w ; i++)
+  {
+    mat1[i] = MAT_ELEM_INIT(first_row * w + i);
+  }
+}
+
+/**
+ * \brief Returns the number of elements of the column panels of second
+ * matrix owned by a rank: panel p belongs to rank p modulo world_size.
+ * \param n column size of second matrix.
+ * \param w row size of second matrix.
+ * \param panel width of panels.
+ * \param rank MPI rank.
+ * \param world_size Total number of MPI nodes.
+ * \return number of elements.
+ */
+size_t mat_panels_size(size_t n, size_t w, size_t panel, size_t rank,
+    size_t world_size)
+{
+  size_t size = 0;
+
+  for(size_t p = rank ; p * panel < n ; p += world_size)
+  {
+    size += (p * panel + panel < n ? panel : n - p * panel) * w;
+  }
+  return size;
+}
+
+/**
+ * \brief Initializes the column panels of second matrix owned by a rank with
+ * the values mat_init() gives to the whole matrix. Owned panels are stored
+ * one after the other, each one contiguous (w x width of panel).
+ * \param mat2 panels of second matrix.
+ * \param n column size of second matrix.
+ * \param w row size of second matrix.
+ * \param panel width of panels.
+ * \param rank MPI rank.
+ * \param world_size Total number of MPI nodes.
+ */
+void mat_init_panels(mat_elem_t* mat2, size_t n, size_t w, size_t panel,
+    size_t rank, size_t world_size)
+{
+  for(size_t p = rank ; p * panel < n ; p += world_size)
+  {
+    size_t nb = p * panel + panel < n ? panel : n - p * panel;
+    mat_elem_t* dst = &mat2[p / world_size * panel * w];
+
+    for(size_t k = 0 ; k < w ; k++)
+    {
+      for(size_t j = 0 ; j < nb ; j++)
+      {
+        dst[k * nb + j] = MAT_ELEM_INIT(k * n + p * panel + j);
+      }
+    }
+  }
+}
+
+/**
+ * \brief Reads or writes elements at the current file view of a file, all
+ * processes that opened the file take part.
+ * \param file file.
+ * \param offset offset in the file view (in elements).
+ * \param buf elements.
+ * \param count number of elements.
+ * \param write write elements instead of reading them.
+ * \return 0 if success, -1 if file cannot be accessed or is too short.
+ */
+static int mat_file_access(MPI_File file, MPI_Offset offset, mat_elem_t* buf,
+    size_t count, int write)
+{
+  MPI_Status status;
+  int nb = 0;
+  int ret = 0;
+
+  ret = write ?
+    MPI_File_write_at_all(file, offset, buf, count, MAT_ELEM_MPI, &status) :
+    MPI_File_read_at_all(file, offset, buf, count, MAT_ELEM_MPI, &status);
+
+  if(ret != MPI_SUCCESS)
+  {
+    return -1;
+  }
+
+  MPI_Get_count(&status, MAT_ELEM_MPI, &nb);
+  return (size_t)nb == count ? 0 : -1;
+}
+
+/**
+ * \brief Opens a binary matrix file, elements of the type of this binary are
+ * stored row by row without header.
+ * \param path path of the file.
+ * \param comm processes that access the file.
+ * \param file file to open.
+ * \param write open for writing (file is created if needed, truncated
+ * otherwise).
+ * \return 0 if success, -1 otherwise.
+ */
+static int mat_file_open(const char* path, MPI_Comm comm, MPI_File* file,
+    int write)
+{
+  if(MPI_File_open(comm, path, write ?
+        MPI_MODE_CREATE | MPI_MODE_WRONLY : MPI_MODE_RDONLY, MPI_INFO_NULL,
+        file) != MPI_SUCCESS)
+  {
+    return -1;
+  }
+
+  /* MPI_MODE_CREATE does not truncate, a bigger old file would keep stale
+   * elements after the matrix
+   */
+  if(write && MPI_File_set_size(*file, 0) != MPI_SUCCESS)
+  {
+    MPI_File_close(file);
+    return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * \brief Checks on all processes that sizes given to MPI-IO (counts and
+ * subarray dimensions) fit in an int, so that no process enters collective
+ * calls that others skip.
+ * \param comm processes that access the file.
+ * \param max biggest size of this process.
+ * \return 0 if sizes fit on all processes, -1 otherwise.
+ */
+static int mat_file_check(MPI_Comm comm, size_t max)
+{
+  int fits = max <= INT_MAX;
+  int all = 0;
+
+  MPI_Allreduce(&fits, &all, 1, MPI_INT, MPI_LAND, comm);
+  return all ? 0 : -1;
+}
+
+/**
+ * \brief Reads or writes consecutive rows of a matrix file, all processes of
+ * the communicator take part.
+ * \param path path of the file.
+ * \param comm processes that access the file.
+ * \param mat rows of matrix.
+ * \param first_row first row.
+ * \param rows number of rows.
+ * \param cols column size of the matrix.
+ * \param write write rows instead of reading them.
+ * \return 0 if success, -1 otherwise.
+ */
+int mat_file_rows(const char* path, MPI_Comm comm, mat_elem_t* mat,
+    size_t first_row, size_t rows, size_t cols, int write)
+{
+  MPI_File file;
+  int ret = 0;
+
+  if(mat_file_check(comm, rows * cols) != 0 ||
+      mat_file_open(path, comm, &file, write) != 0)
+  {
+    return -1;
+  }
+
+  /* offsets in elements */
+  MPI_File_set_view(file, 0, MAT_ELEM_MPI, MAT_ELEM_MPI, "native",
+      MPI_INFO_NULL);
+  ret = mat_file_access(file, first_row * cols, mat, rows * cols, write);
+  MPI_File_close(&file);
+  return ret;
+}
+
+/**
+ * \brief Reads the column panels of second matrix owned by a rank from a
+ * matrix file (see mat_init_panels() for the layout), all processes of the
+ * communicator take part. Each panel is read through a subarray view of the
+ * file, one panel per process at a time.
+ * \param path path of the file.
+ * \param comm processes that own panels.
+ * \param mat2 panels of second matrix.
+ * \param n column size of second matrix.
+ * \param w row size of second matrix.
+ * \param panel width of panels.
+ * \param rank rank in comm.
+ * \param world_size size of comm.
+ * \return 0 if success, -1 otherwise.
+ */
+int mat_file_panels(const char* path, MPI_Comm comm, mat_elem_t* mat2,
+    size_t n, size_t w, size_t panel, size_t rank, size_t world_size)
+{
+  size_t nb_panels = (n + panel - 1) / panel;
+  size_t max = w > n ? w : n;
+  MPI_File file;
+  int ret = 0;
+
+  max = max > panel * w ? max : panel * w;
+
+  if(mat_file_check(comm, max) != 0 || mat_file_open(path, comm, &file, 0) != 0)
+  {
+    return -1;
+  }
+
+  /* collective calls, processes without panel left read nothing */
+  for(size_t round = 0 ; round * world_size < nb_panels ; round++)
+  {
+    size_t p = round * world_size + rank;
+    size_t nb = 0;
+    MPI_Datatype type = MAT_ELEM_MPI;
+
+    if(p < nb_panels)
+    {
+      int sizes[2] = {w, n};
+      int subsizes[2] = {w, 0};
+      int starts[2] = {0, p * panel};
+
+      nb = p * panel + panel < n ? panel : n - p * panel;
+      subsizes[1] = nb;
+      MPI_Type_create_subarray(2, sizes, subsizes, starts, MPI_ORDER_C,
+          MAT_ELEM_MPI, &type);
+      MPI_Type_commit(&type);
+    }
+
+    MPI_File_set_view(file, 0, MAT_ELEM_MPI, type, "native", MPI_INFO_NULL);
+
+    if(mat_file_access(file, 0, &mat2[round * panel * w], nb * w, 0) != 0)
+    {
+      ret = -1;
+    }
+
+    if(p < nb_panels)
+    {
+      MPI_Type_free(&type);
+    }
+  }
+
+  MPI_File_close(&file);
+  return ret;
+}
+
+/**
+ * \brief Performs multiplication of matrixes.
+ *
+ * Rows of first matrix and result are split between ranks in proportion to
+ * their number of threads (see mat_split_rows()), so M does not need to be
+ * divisible by the number of ranks. Column panels of second matrix are
+ * spread round-robin (see mat_init_panels()), no rank holds the whole
+ * matrixes.
+ *
+ * Each panel is broadcast by its owner with MPI_Ibcast(), the next one is
+ * posted before the current one is multiplied so that it is in flight during
+ * the multiplication, two buffers receive them in turn. During the last
+ * panel, each chunk of rows is complete and is sent to root right away if
+ * result is gathered, root has posted the receives before multiplying.
+ *
+ * With a node, panels are spread round-robin over nodes instead of ranks and
+ * only node leaders take part in broadcasts. Panels owned by the node and
+ * both receive buffers are in shared memory of the node, read by all of its
+ * processes: second matrix is received once per node.
+ * \param mat1 rows of first matrix of this rank.
+ * \param mat2 panels of second matrix owned by this rank or node (each one
+ * transposed if transposed is set).
+ * \param res rows of result of this rank (beginning of result on root).
+ * \param result whole result (root only).
+ * \param n column size of second matrix.
+ * \param w column size of first matrix.
+ * \param counts number of rows of each rank.
+ * \param displs first row of each rank.
+ * \param rank MPI rank.
+ * \param world_size Total number of MPI nodes.
+ * \param threads number of threads to use (OpenMP only).
+ * \param transposed panels of second matrix are transposed.
+ * \param panel width of column panels of second matrix.
+ * \param gather gather result on root.
+ * \param node shared memory node, receive buffers follow panels of node in
+ * its shared memory (NULL not to share second matrix).
+ * \return 0 if success, -1 if memory cannot be allocated.
+ */
+int mat_mult_mpi(const mat_elem_t* mat1, mat_elem_t* mat2, mat_elem_t* res,
+    mat_elem_t* result, size_t n, size_t w, const int* counts,
+    const int* displs, size_t rank, size_t world_size, size_t threads,
+    int transposed, size_t panel, int gather, const struct mat_node* node)
+{
+  size_t nb_panels = (n + panel - 1) / panel;
+  size_t rows = counts[rank];
+  /* panels are owned by ranks, or by nodes and broadcast by leaders */
+  size_t owners = node ? (size_t)node->count : world_size;
+  size_t me = node ? (size_t)node->id : rank;
+  MPI_Comm comm = node ? node->leaders : MPI_COMM_WORLD;
+  int bcast = !node || node->rank == 0;
+  size_t owned = mat_panels_size(n, w, panel, me, owners);
+  mat_elem_t* bufs[2] = {
+    node ? &mat2[owned] : mat_alloc(panel * w),
+    node ? &mat2[owned + panel * w] : mat_alloc(panel * w)};
+  mat_elem_t* panels[2] = {NULL, NULL};
+  MPI_Request bcasts[2];
+  MPI_Request* chunks = NULL;
+  int nb_chunks = 0;
+
+  /* root receives chunks of rows of the others, the others send theirs */
+  for(size_t r = (rank == 0 ? 1 : rank) ;
+      gather && r < (rank == 0 ? world_size : rank + 1) ; r++)
+  {
+    nb_chunks += (counts[r] + PROGRESS_ROWS - 1) / PROGRESS_ROWS;
+  }
+
+  chunks = malloc(sizeof(MPI_Request) * (nb_chunks + 1));
+
+  if(!bufs[0] || !bufs[1] || !chunks)
+  {
+    if(!node)
+    {
+      free(bufs[0]);
+      free(bufs[1]);
+    }
+    free(chunks);
+    return -1;
+  }
+
+  if(gather && rank == 0)
+  {
+    int c = 0;
+
+    for(size_t r = 1 ; r < world_size ; r++)
+    {
+      for(int first = 0, tag = 0 ; first < counts[r] ;
+          first += PROGRESS_ROWS, tag++)
+      {
+        int nb = counts[r] - first < (int)PROGRESS_ROWS ?
+          counts[r] - first : (int)PROGRESS_ROWS;
+
+        MPI_Irecv(&result[(displs[r] + first) * n], nb * n, MAT_ELEM_MPI, r,
+            tag, MPI_COMM_WORLD, &chunks[c++]);
+      }
+    }
+  }
+
+	/* matrix multiply */
+
+  for(size_t p = 0 ; p < nb_panels ; p++)
+  {
+    size_t nb = p * panel + panel < n ? panel : n - p * panel;
+    int last = p + 1 == nb_panels;
+    int sent = 0;
+    int done = 0;
+
+    /* post broadcast of first panel, then of the next one before the
+     * current one is multiplied (with a node, once all its processes are
+     * done with the previous panel, whose buffer receives the next one)
+     */
+    for(size_t q = p ? p + 1 : 0 ; q <= p + 1 && q < nb_panels ; q++)
+    {
+      size_t qnb = q * panel + panel < n ? panel : n - q * panel;
+
+      if(node && q > p)
+      {
+        if(bcast)
+        {
+          MPI_Wait(&bcasts[p % 2], MPI_STATUS_IGNORE);
+        }
+        mat_node_sync(node);
+      }
+
+      /* owner sends its own copy */
+      panels[q % 2] = q % owners == me ?
+        &mat2[q / owners * panel * w] : bufs[q % 2];
+
+      if(bcast)
+      {
+        MPI_Ibcast(panels[q % 2], qnb * w, MAT_ELEM_MPI, q % owners, comm,
+            &bcasts[q % 2]);
+      }
+    }
+
+    if(node && p + 1 == nb_panels)
+    {
+      if(bcast)
+      {
+        MPI_Wait(&bcasts[p % 2], MPI_STATUS_IGNORE);
+      }
+      mat_node_sync(node);
+    }
+    else if(!node)
+    {
+      MPI_Wait(&bcasts[p % 2], MPI_STATUS_IGNORE);
+    }
+
+    for(size_t r = 0 ; r < rows ; r += PROGRESS_ROWS)
+    {
+      size_t chunk_rows = r + PROGRESS_ROWS < rows ? PROGRESS_ROWS : rows - r;
+
+      if(transposed)
+      {
+        mat_mult_rows_transposed(&mat1[r * w], panels[p % 2],
+            &res[r * n + p * panel], chunk_rows, nb, w, n, threads);
+      }
+      else
+      {
+        mat_mult_rows(&mat1[r * w], panels[p % 2], &res[r * n + p * panel],
+            chunk_rows, nb, w, nb, n, threads, 0);
+      }
+
+      if(last && gather && rank != 0)
+      {
+        /* rows are complete */
+        MPI_Isend(&res[r * n], chunk_rows * n, MAT_ELEM_MPI, 0,
+            r / PROGRESS_ROWS, MPI_COMM_WORLD, &chunks[sent++]);
+      }
+
+      /* let MPI progress next panel and chunks of result */
+      if(!last && !done && bcast)
+      {
+        MPI_Test(&bcasts[(p + 1) % 2], &done, MPI_STATUS_IGNORE);
+      }
+      else if(last && (rank == 0 ? nb_chunks : sent))
+      {
+        MPI_Testall(rank == 0 ? nb_chunks : sent, chunks, &done,
+            MPI_STATUSES_IGNORE);
+      }
+    }
+  }
+
+  MPI_Waitall(nb_chunks, chunks, MPI_STATUSES_IGNORE);
+
+  if(!node)
+  {
+    free(bufs[0]);
+    free(bufs[1]);
+  }
+  free(chunks);
+  MPI_Barrier(MPI_COMM_WORLD);
+  return 0;
+}
+
+/**
+ * \brief Performs multiplication of matrixes with one-sided communications.
+ *
+ * Rows and panels are spread as with mat_mult_mpi(), but each rank exposes
+ * its panels of second matrix in a window (MPI_Win_create()) and reads the
+ * panels of the others with MPI_Rget() in a passive target epoch, so that no
+ * rank waits for a late owner to enter a broadcast. Rank r starts with panel
+ * r to spread reads over owners, and the read of the next panel is posted
+ * before the current one is multiplied, two buffers receive them in turn.
+ * Result is sent to root once complete if gathered.
+ * \param mat1 rows of first matrix of this rank.
+ * \param mat2 panels of second matrix owned by this rank (each one transposed
+ * if transposed is set).
+ * \param res rows of result of this rank (beginning of result on root).
+ * \param result whole result (root only).
+ * \param n column size of second matrix.
+ * \param w column size of first matrix.
+ * \param counts number of rows of each rank.
+ * \param displs first row of each rank.
+ * \param rank MPI rank.
+ * \param world_size Total number of MPI nodes.
+ * \param threads number of threads to use (OpenMP only).
+ * \param transposed panels of second matrix are transposed.
+ * \param panel width of column panels of second matrix.
+ * \param gather gather result on root.
+ * \return 0 if success, -1 if memory cannot be allocated.
+ */
+int mat_mult_rma(const mat_elem_t* mat1, mat_elem_t* mat2, mat_elem_t* res,
+    mat_elem_t* result, size_t n, size_t w, const int* counts,
+    const int* displs, size_t rank, size_t world_size, size_t threads,
+    int transposed, size_t panel, int gather)
+{
+  size_t nb_panels = (n + panel - 1) / panel;
+  size_t rows = counts[rank];
+  size_t owned = mat_panels_size(n, w, panel, rank, world_size);
+  mat_elem_t* bufs[2] = {mat_alloc(panel * w), mat_alloc(panel * w)};
+  mat_elem_t* panels[2] = {NULL, NULL};
+  MPI_Request gets[2] = {MPI_REQUEST_NULL, MPI_REQUEST_NULL};
+  MPI_Win win;
+
+  if(!bufs[0] || !bufs[1])
+  {
+    free(bufs[0]);
+    free(bufs[1]);
+    return -1;
+  }
+
+  MPI_Win_create(mat2, owned * sizeof(mat_elem_t), sizeof(mat_elem_t),
+      MPI_INFO_NULL, MPI_COMM_WORLD, &win);
+  /* panels are never written during multiplication, no conflict */
+  MPI_Win_lock_all(MPI_MODE_NOCHECK, win);
+
+  for(size_t i = 0 ; i < nb_panels ; i++)
+  {
+    size_t p = (rank + i) % nb_panels;
+    size_t nb = p * panel + panel < n ? panel : n - p * panel;
+    int done = 0;
+
+    /* post read of first panel, then of the next one before the current one
+     * is multiplied, owner uses its own copy
+     */
+    for(size_t j = i ? i + 1 : 0 ; j <= i + 1 && j < nb_panels ; j++)
+    {
+      size_t q = (rank + j) % nb_panels;
+      size_t qnb = q * panel + panel < n ? panel : n - q * panel;
+      size_t owner = q % world_size;
+      size_t offset = q / world_size * panel * w;
+
+      if(owner == rank)
+      {
+        panels[j % 2] = &mat2[offset];
+        continue;
+      }
+
+      panels[j % 2] = bufs[j % 2];
+      MPI_Rget(panels[j % 2], qnb * w, MAT_ELEM_MPI, owner, offset, qnb * w,
+          MAT_ELEM_MPI, win, &gets[j % 2]);
+    }
+
+    MPI_Wait(&gets[i % 2], MPI_STATUS_IGNORE);
+
+    for(size_t r = 0 ; r < rows ; r += PROGRESS_ROWS)
+    {
+      size_t chunk_rows = r + PROGRESS_ROWS < rows ? PROGRESS_ROWS : rows - r;
+
+      if(transposed)
+      {
+        mat_mult_rows_transposed(&mat1[r * w], panels[i % 2],
+            &res[r * n + p * panel], chunk_rows, nb, w, n, threads);
+      }
+      else
+      {
+        mat_mult_rows(&mat1[r * w], panels[i % 2], &res[r * n + p * panel],
+            chunk_rows, nb, w, nb, n, threads, 0);
+      }
+
+      /* let MPI progress next panel */
+      if(!done)
+      {
+        MPI_Test(&gets[(i + 1) % 2], &done, MPI_STATUS_IGNORE);
+      }
+    }
+  }
+
+  MPI_Win_unlock_all(win);
+  /* collective, owners keep their panels until everyone has read them */
+  MPI_Win_free(&win);
+
+  if(gather && rank == 0)
+  {
+    for(size_t r = 1 ; r < world_size ; r++)
+    {
+      MPI_Recv(&result[displs[r] * n], counts[r] * n, MAT_ELEM_MPI, r, 0,
+          MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    }
+  }
+  else if(gather)
+  {
+    MPI_Send(res, rows * n, MAT_ELEM_MPI, 0, 0, MPI_COMM_WORLD);
+  }
+
+  free(bufs[0]);
+  free(bufs[1]);
+  return 0;
+}
+
+/**
+ * \brief Gets the index-th of parts ranges of a dimension, ranges differ by
+ * one element at most.
+ * \param size size of dimension.
+ * \param parts number of ranges.
+ * \param index index of range.
+ * \param first first element of range.
+ * \param count number of elements of range.
+ */
+static void mat_range(size_t size, size_t parts, size_t index, size_t* first,
+    size_t* count)
+{
+  *first = size * index / parts;
+  *count = size * (index + 1) / parts - *first;
+}
+
+/**
+ * \brief Gets the index of the range (see mat_range()) containing an element.
+ * \param size size of dimension.
+ * \param parts number of ranges.
+ * \param k element.
+ * \return index of range.
+ */
+static size_t mat_range_owner(size_t size, size_t parts, size_t k)
+{
+  size_t index = 0;
+
+  while(size * (index + 1) / parts <= k)
+  {
+    index++;
+  }
+  return index;
+}
+
+/**
+ * \brief Creates a grid of layers, each layer is a 2D grid as square as
+ * possible.
+ * \param grid grid to initialize.
+ * \param world_size Total number of MPI nodes.
+ * \param periodic layers wrap around in both dimensions.
+ * \param layers number of layers, it divides world_size.
+ * \return 0 if success, -1 otherwise.
+ */
+int mat_grid_init(struct mat_grid* grid, int world_size, int periodic,
+    int layers)
+{
+  int periods[3] = {periodic, periodic, 0};
+  int keep_cols[3] = {0, 1, 0};
+  int keep_rows[3] = {1, 0, 0};
+  int keep_layer[3] = {1, 1, 0};
+  int keep_depth[3] = {0, 0, 1};
+  int rank = 0;
+
+  if(world_size % layers)
+  {
+    return -1;
+  }
+
+  grid->dims[0] = 0;
+  grid->dims[1] = 0;
+  grid->dims[2] = layers;
+  MPI_Dims_create(world_size / layers, 2, grid->dims);
+
+  /* no reordering, rank 0 of grid is rank 0 of world */
+  if(MPI_Cart_create(MPI_COMM_WORLD, 3, grid->dims, periods, 0,
+        &grid->comm) != MPI_SUCCESS)
+  {
+    return -1;
+  }
+
+  MPI_Comm_rank(grid->comm, &rank);
+  MPI_Cart_coords(grid->comm, rank, 3, grid->coords);
+  MPI_Cart_sub(grid->comm, keep_cols, &grid->row_comm);
+  MPI_Cart_sub(grid->comm, keep_rows, &grid->col_comm);
+  MPI_Cart_sub(grid->comm, keep_layer, &grid->layer_comm);
+  MPI_Cart_sub(grid->comm, keep_depth, &grid->depth_comm);
+  return 0;
+}
+
+/**
+ * \brief Frees communicators of a grid.
+ * \param grid grid.
+ */
+void mat_grid_destroy(struct mat_grid* grid)
+{
+  MPI_Comm_free(&grid->row_comm);
+  MPI_Comm_free(&grid->col_comm);
+  MPI_Comm_free(&grid->layer_comm);
+  MPI_Comm_free(&grid->depth_comm);
+  MPI_Comm_free(&grid->comm);
+}
+
+/**
+ * \brief Initializes the block of a matrix owned by this process with the
+ * values mat_init() gives to the whole matrix.
+ * \param block block of matrix.
+ * \param rows row size of the matrix.
+ * \param cols column size of the matrix.
+ * \param grid process grid.
+ */
+void mat_init_block(mat_elem_t* block, size_t rows, size_t cols,
+    const struct mat_grid* grid)
+{
+  size_t first_row = 0;
+  size_t nb_rows = 0;
+  size_t first_col = 0;
+  size_t nb_cols = 0;
+
+  mat_range(rows, grid->dims[0], grid->coords[0], &first_row, &nb_rows);
+  mat_range(cols, grid->dims[1], grid->coords[1], &first_col, &nb_cols);
+
+  for(size_t i = 0 ; i < nb_rows ; i++)
+  {
+    for(size_t j = 0 ; j < nb_cols ; j++)
+    {
+      block[i * nb_cols + j] =
+        MAT_ELEM_INIT((first_row + i) * cols + first_col + j);
+    }
+  }
+}
+
+/**
+ * \brief Reads or writes the blocks of a matrix file owned by the first
+ * layer of the grid through a subarray view of the file, all processes of
+ * the grid take part (other layers access nothing).
+ * \param path path of the file.
+ * \param block block of matrix.
+ * \param rows row size of the matrix.
+ * \param cols column size of the matrix.
+ * \param grid process grid.
+ * \param write write block instead of reading it.
+ * \return 0 if success, -1 otherwise.
+ */
+int mat_file_block(const char* path, mat_elem_t* block, size_t rows,
+    size_t cols, const struct mat_grid* grid, int write)
+{
+  size_t first_row = 0;
+  size_t nb_rows = 0;
+  size_t first_col = 0;
+  size_t nb_cols = 0;
+  size_t max = 0;
+  MPI_Datatype type = MAT_ELEM_MPI;
+  MPI_File file;
+  int ret = 0;
+
+  mat_range(rows, grid->dims[0], grid->coords[0], &first_row, &nb_rows);
+  mat_range(cols, grid->dims[1], grid->coords[1], &first_col, &nb_cols);
+
+  if(grid->coords[2] != 0)
+  {
+    nb_rows = 0;
+  }
+
+  max = rows > cols ? rows : cols;
+  max = max > nb_rows * nb_cols ? max : nb_rows * nb_cols;
+
+  if(mat_file_check(grid->comm, max) != 0 ||
+      mat_file_open(path, grid->comm, &file, write) != 0)
+  {
+    return -1;
+  }
+
+  if(nb_rows && nb_cols)
+  {
+    int sizes[2] = {rows, cols};
+    int subsizes[2] = {nb_rows, nb_cols};
+    int starts[2] = {first_row, first_col};
+
+    MPI_Type_create_subarray(2, sizes, subsizes, starts, MPI_ORDER_C,
+        MAT_ELEM_MPI, &type);
+    MPI_Type_commit(&type);
+  }
+
+  MPI_File_set_view(file, 0, MAT_ELEM_MPI, type, "native", MPI_INFO_NULL);
+  ret = mat_file_access(file, 0, block, nb_rows * nb_cols, write);
+
+  if(nb_rows && nb_cols)
+  {
+    MPI_Type_free(&type);
+  }
+
+  MPI_File_close(&file);
+  return ret;
+}
+
+/**
+ * \brief Gathers blocks of a matrix of a layer on its rank 0 (rank 0 of the
+ * grid for first layer).
+ * \param block block of matrix owned by this process.
+ * \param mat whole matrix (rank 0 only).
+ * \param rows row size of the matrix.
+ * \param cols column size of the matrix.
+ * \param grid process grid.
+ * \return 0 if success, -1 if memory cannot be allocated.
+ */
+int mat_gather_blocks(const mat_elem_t* block, mat_elem_t* mat, size_t rows,
+    size_t cols, const struct mat_grid* grid)
+{
+  size_t first_row = 0;
+  size_t nb_rows = 0;
+  size_t first_col = 0;
+  size_t nb_cols = 0;
+  int rank = 0;
+  int size = 0;
+  mat_elem_t* tmp = NULL;
+
+  MPI_Comm_rank(grid->layer_comm, &rank);
+  MPI_Comm_size(grid->layer_comm, &size);
+
+  if(rank != 0)
+  {
+    mat_range(rows, grid->dims[0], grid->coords[0], &first_row, &nb_rows);
+    mat_range(cols, grid->dims[1], grid->coords[1], &first_col, &nb_cols);
+    MPI_Send(block, nb_rows * nb_cols, MAT_ELEM_MPI, 0, 0, grid->layer_comm);
+    return 0;
+  }
+
+  /* largest block */
+  tmp = mat_alloc((rows / grid->dims[0] + 1) * (cols / grid->dims[1] + 1));
+
+  if(!tmp)
+  {
+    return -1;
+  }
+
+  for(int r = 0 ; r < size ; r++)
+  {
+    int coords[2];
+    const mat_elem_t* src = block;
+
+    MPI_Cart_coords(grid->layer_comm, r, 2, coords);
+    mat_range(rows, grid->dims[0], coords[0], &first_row, &nb_rows);
+    mat_range(cols, grid->dims[1], coords[1], &first_col, &nb_cols);
+
+    if(r != 0)
+    {
+      MPI_Recv(tmp, nb_rows * nb_cols, MAT_ELEM_MPI, r, 0, grid->layer_comm,
+          MPI_STATUS_IGNORE);
+      src = tmp;
+    }
+
+    for(size_t i = 0 ; i < nb_rows ; i++)
+    {
+      memcpy(&mat[(first_row + i) * cols + first_col], &src[i * nb_cols],
+          nb_cols * sizeof(mat_elem_t));
+    }
+  }
+
+  free(tmp);
+  return 0;
+}
+
+/**
+ * \brief Performs multiplication of matrixes with SUMMA algorithm.
+ *
+ * Each process holds one block of each matrix. For each panel of the common
+ * dimension, the process owning the columns of first matrix broadcasts them
+ * along its grid row and the process owning the rows of second matrix
+ * broadcasts them along its grid column, then every process adds the product
+ * of both panels to its block of result. Panels never cross a block boundary
+ * of first or second matrix. Only the range [k_first, k_last) of the common
+ * dimension is multiplied, so that layers of mat_mult_25d() can share it.
+ * \param a block of first matrix.
+ * \param b block of second matrix.
+ * \param c block of result matrix.
+ * \param m row size of first matrix.
+ * \param n column size of second matrix.
+ * \param w column size of first matrix.
+ * \param k_first first index of common dimension to multiply.
+ * \param k_last index after the last one of common dimension to multiply.
+ * \param grid process grid.
+ * \param panel maximum width of panels.
+ * \param threads number of threads to use (OpenMP only).
+ * \return 0 if success, -1 if memory cannot be allocated.
+ */
+int mat_mult_summa(const mat_elem_t* a, mat_elem_t* b, mat_elem_t* c,
+    size_t m, size_t n, size_t w, size_t k_first, size_t k_last,
+    const struct mat_grid* grid, size_t panel, size_t threads)
+{
+  size_t a_row = 0;
+  size_t a_rows = 0;
+  size_t a_col = 0;
+  size_t a_cols = 0;
+  size_t b_row = 0;
+  size_t b_rows = 0;
+  size_t b_col = 0;
+  size_t b_cols = 0;
+  mat_elem_t* a_panel = NULL;
+  mat_elem_t* b_panel = NULL;
+
+  /* result block has the rows of first matrix and columns of second one */
+  mat_range(m, grid->dims[0], grid->coords[0], &a_row, &a_rows);
+  mat_range(w, grid->dims[1], grid->coords[1], &a_col, &a_cols);
+  mat_range(w, grid->dims[0], grid->coords[0], &b_row, &b_rows);
+  mat_range(n, grid->dims[1], grid->coords[1], &b_col, &b_cols);
+
+  a_panel = mat_alloc(a_rows * panel + 1);
+  b_panel = mat_alloc(panel * b_cols + 1);
+
+  if(!a_panel || !b_panel)
+  {
+    free(a_panel);
+    free(b_panel);
+    return -1;
+  }
+
+  memset(c, 0x00, a_rows * b_cols * sizeof(mat_elem_t));
+
+  for(size_t k = k_first ; k < k_last ; )
+  {
+    size_t a_owner = mat_range_owner(w, grid->dims[1], k);
+    size_t b_owner = mat_range_owner(w, grid->dims[0], k);
+    size_t first = 0;
+    size_t count = 0;
+    size_t kb = k_last - k < panel ? k_last - k : panel;
+    mat_elem_t* bk = b_panel;
+
+    /* stop panel at the end of both blocks that hold it */
+    mat_range(w, grid->dims[1], a_owner, &first, &count);
+    kb = first + count - k < kb ? first + count - k : kb;
+    mat_range(w, grid->dims[0], b_owner, &first, &count);
+    kb = first + count - k < kb ? first + count - k : kb;
+
+    /* columns of first matrix are packed, rows of second one are already
+     * contiguous in their block
+     */
+    if((size_t)grid->coords[1] == a_owner)
+    {
+      for(size_t i = 0 ; i < a_rows ; i++)
+      {
+        memcpy(&a_panel[i * kb], &a[i * a_cols + k - a_col],
+            kb * sizeof(mat_elem_t));
+      }
+    }
+
+    if((size_t)grid->coords[0] == b_owner)
+    {
+      bk = &b[(k - b_row) * b_cols];
+    }
+
+    MPI_Bcast(a_panel, a_rows * kb, MAT_ELEM_MPI, a_owner, grid->row_comm);
+    MPI_Bcast(bk, kb * b_cols, MAT_ELEM_MPI, b_owner, grid->col_comm);
+
+    mat_mult_rows(a_panel, bk, c, a_rows, b_cols, kb, b_cols, b_cols,
+        threads, 1);
+    k += kb;
+  }
+
+  free(a_panel);
+  free(b_panel);
+  return 0;
+}
+
+/**
+ * \brief Performs multiplication of matrixes with 2.5D algorithm.
+ *
+ * Blocks of first and second matrixes are initialized on the first layer of
+ * the grid and replicated on the other layers. Each layer then runs SUMMA on
+ * its own range of the common dimension, so that a process broadcasts c
+ * times less panels than with a single layer of the same blocks, and partial
+ * results are summed on the first layer.
+ * \param a block of first matrix.
+ * \param b block of second matrix.
+ * \param c block of result matrix, complete on first layer only.
+ * \param m row size of first matrix.
+ * \param n column size of second matrix.
+ * \param w column size of first matrix.
+ * \param grid process grid.
+ * \param panel maximum width of panels.
+ * \param threads number of threads to use (OpenMP only).
+ * \return 0 if success, -1 if memory cannot be allocated.
+ */
+int mat_mult_25d(mat_elem_t* a, mat_elem_t* b, mat_elem_t* c, size_t m,
+    size_t n, size_t w, const struct mat_grid* grid, size_t panel,
+    size_t threads)
+{
+  size_t first = 0;
+  size_t a_rows = 0;
+  size_t a_cols = 0;
+  size_t b_rows = 0;
+  size_t b_cols = 0;
+  size_t k_first = 0;
+  size_t k_count = 0;
+
+  mat_range(m, grid->dims[0], grid->coords[0], &first, &a_rows);
+  mat_range(w, grid->dims[1], grid->coords[1], &first, &a_cols);
+  mat_range(w, grid->dims[0], grid->coords[0], &first, &b_rows);
+  mat_range(n, grid->dims[1], grid->coords[1], &first, &b_cols);
+  mat_range(w, grid->dims[2], grid->coords[2], &k_first, &k_count);
+
+  /* rank in depth communicator is the layer */
+  MPI_Bcast(a, a_rows * a_cols, MAT_ELEM_MPI, 0, grid->depth_comm);
+  MPI_Bcast(b, b_rows * b_cols, MAT_ELEM_MPI, 0, grid->depth_comm);
+
+  if(mat_mult_summa(a, b, c, m, n, w, k_first, k_first + k_count, grid,
+        panel, threads) == -1)
+  {
+    return -1;
+  }
+
+  if(grid->coords[2] == 0)
+  {
+    MPI_Reduce(MPI_IN_PLACE, c, a_rows * b_cols, MAT_ELEM_MPI, MPI_SUM, 0,
+        grid->depth_comm);
+  }
+  else
+  {
+    MPI_Reduce(c, NULL, a_rows * b_cols, MAT_ELEM_MPI, MPI_SUM, 0,
+        grid->depth_comm);
+  }
+
+  return 0;
+}
+
+/**
+ * \brief Performs multiplication of matrixes with Cannon algorithm on a
+ * square periodic grid of q x q processes.
+ *
+ * Blocks of first matrix are skewed left by their row coordinate and blocks
+ * of second matrix up by their column coordinate, so that process (i, j)
+ * holds blocks (i, k) and (k, j) with k = (i + j) mod q. Then for q steps,
+ * each process multiplies its blocks while the next ones are shifted by one
+ * process (left for first matrix, up for second one) into a second pair of
+ * buffers with nonblocking sends and receives. Rows are computed by chunks,
+ * and requests are tested between chunks so that MPI progresses the shifts
+ * during the multiplication.
+ * \param a block of first matrix.
+ * \param b block of second matrix.
+ * \param c block of result matrix.
+ * \param m row size of first matrix.
+ * \param n column size of second matrix.
+ * \param w column size of first matrix.
+ * \param grid square periodic process grid.
+ * \param threads number of threads to use (OpenMP only).
+ * \return 0 if success, -1 if memory cannot be allocated.
+ */
+int mat_mult_cannon(mat_elem_t* a, mat_elem_t* b, mat_elem_t* c, size_t m,
+    size_t n, size_t w, const struct mat_grid* grid, size_t threads)
+{
+  size_t q = grid->dims[0];
+  size_t i = grid->coords[0];
+  size_t j = grid->coords[1];
+  size_t a_row = 0;
+  size_t a_rows = 0;
+  size_t b_col = 0;
+  size_t b_cols = 0;
+  size_t first = 0;
+  size_t count = 0;
+  size_t k = (i + j) % q;
+  size_t kw = 0;
+  size_t max_k = w / q + 1;
+  mat_elem_t* a_bufs[2] = {NULL, NULL};
+  mat_elem_t* b_bufs[2] = {NULL, NULL};
+  int src = 0;
+  int dst = 0;
+  int left = 0;
+  int right = 0;
+  int up = 0;
+  int down = 0;
+
+  mat_range(m, q, i, &a_row, &a_rows);
+  mat_range(n, q, j, &b_col, &b_cols);
+
+  for(size_t x = 0 ; x < 2 ; x++)
+  {
+    a_bufs[x] = mat_alloc(a_rows * max_k + 1);
+    b_bufs[x] = mat_alloc(max_k * b_cols + 1);
+  }
+
+  if(!a_bufs[0] || !a_bufs[1] || !b_bufs[0] || !b_bufs[1])
+  {
+    for(size_t x = 0 ; x < 2 ; x++)
+    {
+      free(a_bufs[x]);
+      free(b_bufs[x]);
+    }
+    return -1;
+  }
+
+  /* initial skew: block (i, j) of first matrix goes to column j - i and
+   * block (i, j) of second one to row i - j
+   */
+  mat_range(w, q, j, &first, &count);
+  mat_range(w, q, k, &first, &kw);
+  MPI_Cart_shift(grid->layer_comm, 1, -(int)i, &src, &dst);
+  MPI_Sendrecv(a, a_rows * count, MAT_ELEM_MPI, dst, 0,
+      a_bufs[0], a_rows * kw, MAT_ELEM_MPI, src, 0, grid->layer_comm,
+      MPI_STATUS_IGNORE);
+
+  mat_range(w, q, i, &first, &count);
+  MPI_Cart_shift(grid->layer_comm, 0, -(int)j, &src, &dst);
+  MPI_Sendrecv(b, count * b_cols, MAT_ELEM_MPI, dst, 1,
+      b_bufs[0], kw * b_cols, MAT_ELEM_MPI, src, 1, grid->layer_comm,
+      MPI_STATUS_IGNORE);
+
+  MPI_Cart_shift(grid->layer_comm, 1, -1, &right, &left);
+  MPI_Cart_shift(grid->layer_comm, 0, -1, &down, &up);
+
+  memset(c, 0x00, a_rows * b_cols * sizeof(mat_elem_t));
+
+  for(size_t step = 0 ; step < q ; step++)
+  {
+    MPI_Request requests[4];
+    int nb_requests = 0;
+    size_t next_kw = 0;
+    int done = 0;
+
+    /* shift blocks for next step while multiplying current ones */
+    if(step + 1 < q)
+    {
+      mat_range(w, q, (k + 1) % q, &first, &next_kw);
+      MPI_Irecv(a_bufs[1], a_rows * next_kw, MAT_ELEM_MPI, right, 0,
+          grid->layer_comm, &requests[0]);
+      MPI_Irecv(b_bufs[1], next_kw * b_cols, MAT_ELEM_MPI, down, 1,
+          grid->layer_comm, &requests[1]);
+      MPI_Isend(a_bufs[0], a_rows * kw, MAT_ELEM_MPI, left, 0, grid->layer_comm,
+          &requests[2]);
+      MPI_Isend(b_bufs[0], kw * b_cols, MAT_ELEM_MPI, up, 1, grid->layer_comm,
+          &requests[3]);
+      nb_requests = 4;
+    }
+
+    for(size_t r = 0 ; r < a_rows ; r += PROGRESS_ROWS)
+    {
+      size_t rows = r + PROGRESS_ROWS < a_rows ? PROGRESS_ROWS : a_rows - r;
+
+      mat_mult_rows(&a_bufs[0][r * kw], b_bufs[0], &c[r * b_cols], rows,
+          b_cols, kw, b_cols, b_cols, threads, 1);
+
+      if(nb_requests && !done)
+      {
+        MPI_Testall(nb_requests, requests, &done, MPI_STATUSES_IGNORE);
+      }
+    }
+
+    if(nb_requests)
+    {
+      mat_elem_t* tmp = NULL;
+
+      MPI_Waitall(nb_requests, requests, MPI_STATUSES_IGNORE);
+
+      tmp = a_bufs[0];
+      a_bufs[0] = a_bufs[1];
+      a_bufs[1] = tmp;
+      tmp = b_bufs[0];
+      b_bufs[0] = b_bufs[1];
+      b_bufs[1] = tmp;
+      k = (k + 1) % q;
+      kw = next_kw;
+    }
+  }
+
+  for(size_t x = 0 ; x < 2 ; x++)
+  {
+    free(a_bufs[x]);
+    free(b_bufs[x]);
+  }
+  return 0;
+}
+
+/**
+ * \brief Print help.
+ * \param program program name.
+ */
+void print_help(const char* program)
+{
+  fprintf(stdout, "Usage: %s [-m size] [-M rows] [-K common] [-N columns] "
+#ifdef _OPENMP
+      "[-t thread_number]"
+#endif
+      "[-a algorithm] [-b panel] [-c layers] [-A file] [-B file] [-C file] "
+      "[-T] [-S] [-g] [-p] [-h]\n\n"
+      "  -h\t\tDisplay this help\n"
+#ifdef _OPENMP
+      "  -t nb\t\tDefines number of threads to use\n"
+#endif
+      "  -a algo\tAlgorithm: rows (default), rma, summa, cannon or 25d\n"
+      "  -b panel\tWidth of panels of rows, rma, summa and 25d (default "
+      "256)\n"
+      "  -c layers\tNumber of replicated layers of 25d (default 2)\n"
+      "  -A file\tRead first matrix from binary file\n"
+      "  -B file\tRead second matrix from binary file\n"
+      "  -C file\tWrite result to binary file\n"
+      "  -T\t\tTranspose second matrix before multiplication (rows and rma "
+      "only)\n"
+      "  -S\t\tShare second matrix between processes of a node (rows "
+      "only)\n"
+      "  -g\t\tGather result on rank 0\n"
+      "  -p\t\tPrint the input and output matrixes (implies -g)\n"
+      "  -m size\tSize of square matrixes (default 1024)\n"
+      "  -M rows\tRow size of first matrix (default -m)\n"
+      "  -K common\tColumn size of first matrix (default -m)\n"
+      "  -N columns\tColumn size of second matrix (default -m)\n",
+      program);
+}
+
+/**
+ * \brief Parse command line.
+ * \param argc number of arguments.
+ * \param argv array of arguments.
+ * \param configuration configuration parameters.
+ * \return 0 to exit with success, -1 to exit with error, otherwise continue.
+ */
+int parse_cmdline(int argc, char** argv,
+    struct configuration* configuration)
+{
+  /*
+   * h: print help and exit
+   * p: print input and output matrixes
+   * m: square size
+   * M: row size of first matrix
+   * K: common dimension
+   * N: column size of second matrix
+   * t: number of threads to use
+   * T: transpose second matrix
+   * a: algorithm
+   * b: width of panels
+   * g: gather result
+   * S: share second matrix in node
+   * c: number of layers of 2.5D
+   * A: file of first matrix
+   * B: file of second matrix
+   * C: file of result
+   */
+  static const char* options = "hpm:M:K:N:t:Ta:b:gSc:A:B:C:";
+  int opt = 0;
+  int print_matrix = 0;
+  int gather = 0;
+  int shared = 0;
+  long m = DEFAULT_ROW_SIZE;
+  long dims[3] = {0, 0, 0};
+  int threads = sysconf(_SC_NPROCESSORS_ONLN);
+  int transpose = 0;
+  enum mat_algorithm algorithm = MAT_ROWS;
+  long panel = DEFAULT_PANEL_SIZE;
+  long layers = 0;
+  const char* files[3] = {NULL, NULL, NULL};
+  int ret = 1;
+
+  assert(configuration);
+
+  while((opt = getopt(argc, argv, options)) != -1)
+  {
+    switch(opt)
+    {
+      case 'h':
+        /* help */
+        print_help(argv[0]);
+        return 0;
+        break;
+      case 'p':
+        print_matrix = 1;
+        break;
+      case 'm':
+        m = atol(optarg);
+        if(m < 2)
+        {
+          fprintf(stderr, "Bad argument for '-m' %ld\n", m);
+          ret = -1;
+        }
+        break;
+      case 'M':
+      case 'K':
+      case 'N':
+        dims[opt == 'M' ? 0 : opt == 'K' ? 1 : 2] = atol(optarg);
+        if(atol(optarg) < 1)
+        {
+          fprintf(stderr, "Bad argument for '-%c': %s\n", opt, optarg);
+          ret = -1;
+        }
+        break;
+      case 't':
+        threads = atol(optarg);
+        if(threads <= 0)
+        {
+          fprintf(stderr, "Bad argument for '-t': %s\n", optarg);
+          ret = EXIT_FAILURE;
+        }
+        break;
+      case 'T':
+        transpose = 1;
+        break;
+      case 'g':
+        gather = 1;
+        break;
+      case 'S':
+        shared = 1;
+        break;
+      case 'a':
+        if(!strcmp(optarg, "rows"))
+        {
+          algorithm = MAT_ROWS;
+        }
+        else if(!strcmp(optarg, "rma"))
+        {
+          algorithm = MAT_RMA;
+        }
+        else if(!strcmp(optarg, "summa"))
+        {
+          algorithm = MAT_SUMMA;
+        }
+        else if(!strcmp(optarg, "cannon"))
+        {
+          algorithm = MAT_CANNON;
+        }
+        else if(!strcmp(optarg, "25d"))
+        {
+          algorithm = MAT_25D;
+        }
+        else
+        {
+          fprintf(stderr, "Bad argument for '-a': %s\n", optarg);
+          ret = -1;
+        }
+        break;
+      case 'b':
+        panel = atol(optarg);
+        if(panel < 1)
+        {
+          fprintf(stderr, "Bad argument for '-b': %s\n", optarg);
+          ret = -1;
+        }
+        break;
+      case 'A':
+      case 'B':
+      case 'C':
+        files[opt - 'A'] = optarg;
+        break;
+      case 'c':
+        layers = atol(optarg);
+        if(layers < 1)
+        {
+          fprintf(stderr, "Bad argument for '-c': %s\n", optarg);
+          ret = -1;
+        }
+        break;
+      default:
+        fprintf(stderr, "Bad option (%c)\n", optopt);
+        ret = -1;
+        break;
+    }
+  }
+
+  if(transpose && algorithm != MAT_ROWS && algorithm != MAT_RMA)
+  {
+    fprintf(stderr, "Option '-T' requires rows or rma algorithm\n");
+    ret = -1;
+  }
+
+  if(shared && algorithm != MAT_ROWS)
+  {
+    fprintf(stderr, "Option '-S' requires rows algorithm\n");
+    ret = -1;
+  }
+
+  if(layers && algorithm != MAT_25D)
+  {
+    fprintf(stderr, "Option '-c' requires 25d algorithm\n");
+    ret = -1;
+  }
+
+  configuration->print_matrix = print_matrix;
+  configuration->gather = gather || print_matrix;
+  configuration->shared = shared;
+  configuration->transpose = transpose;
+  configuration->algorithm = algorithm;
+  configuration->panel = panel;
+  configuration->file1 = files[0];
+  configuration->file2 = files[1];
+  configuration->result_file = files[2];
+  configuration->layers = algorithm != MAT_25D ? 1 :
+    layers ? (size_t)layers : DEFAULT_LAYERS;
+  configuration->m = dims[0] ? (size_t)dims[0] : (size_t)m;
+  configuration->w = dims[1] ? (size_t)dims[1] : (size_t)m;
+  configuration->n = dims[2] ? (size_t)dims[2] : (size_t)m;
+#ifdef _OPENMP
+  configuration->threads = threads;
+#else
+  configuration->threads = 1;
+#endif
+
+  return ret;
+}
+
+/**
+ * \brief Runs the row algorithms (rows and rma): each rank initializes only
+ * its rows of first matrix and its column panels of second matrix, result is
+ * gathered on rank 0 only if requested.
+ * \param config configuration.
+ * \param world_rank MPI rank.
+ * \param world_size Total number of MPI nodes.
+ * \return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+int mat_run_rows(const struct configuration* config, int world_rank,
+    int world_size)
+{
+  mat_elem_t* mat1 = NULL;
+  mat_elem_t* mat2 = NULL;
+  mat_elem_t* mat2t = NULL;
+  mat_elem_t* res = NULL;
+  mat_elem_t* result = NULL;
+  struct mat_node node;
+  size_t m = config->m;
+  size_t n = config->n;
+  size_t w = config->w;
+  size_t panel = config->panel;
+  size_t panels_size = 0;
+  int weight = config->threads;
+  int* weights = malloc(sizeof(int) * world_size);
+  int* counts = malloc(sizeof(int) * world_size);
+  int* displs = malloc(sizeof(int) * world_size);
+  size_t rows = 0;
+  double start = 0;
+  double end = 0;
+  int ret = EXIT_SUCCESS;
+
+  if(!weights || !counts || !displs)
+  {
+    perror("malloc");
+    MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+  }
+
+  /* each rank weighs its number of threads */
+  MPI_Allgather(&weight, 1, MPI_INT, weights, 1, MPI_INT, MPI_COMM_WORLD);
+  mat_split_rows(m, weights, world_size, counts, displs);
+  rows = counts[world_rank];
+
+  /* one more element so that ranks without rows or panels allocate */
+  mat1 = mat_alloc(rows * w + 1);
+
+  if(config->shared)
+  {
+    /* panels of node (transposed ones after them with -T) then two receive
+     * buffers in shared memory of node
+     */
+    mat_node_init(&node);
+    panels_size = mat_panels_size(n, w, panel, node.id, node.count);
+
+    if(mat_node_alloc(&node, panels_size * (config->transpose ? 2 : 1) +
+          2 * panel * w) != 0)
+    {
+      fprintf(stderr, "Failed to allocate shared memory\n");
+      MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+
+    mat2 = node.base;
+  }
+  else
+  {
+    panels_size = mat_panels_size(n, w, panel, world_rank, world_size);
+    mat2 = mat_alloc(panels_size + 1);
+  }
+
+  if(world_rank == 0 && config->gather)
+  {
+    /* root computes its rows in place at the beginning of result */
+    result = mat_alloc(m * n);
+    res = result;
+  }
+  else
+  {
+    res = mat_alloc(rows * n + 1);
+  }
+
+  if(!mat1 || !mat2 || !res)
+  {
+    perror("malloc");
+    MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+  }
+
+  MPI_Barrier(MPI_COMM_WORLD);
+  start = MPI_Wtime();
+
+  if(!config->file1)
+  {
+    mat_init_rows(mat1, displs[world_rank], rows, w);
+  }
+  else if(mat_file_rows(config->file1, MPI_COMM_WORLD, mat1,
+        displs[world_rank], rows, w, 0) != 0)
+  {
+    fprintf(stderr, "Failed to read %s\n", config->file1);
+    MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+  }
+
+  /* leader initializes or reads panels of node */
+  if(!config->shared || node.rank == 0)
+  {
+    size_t owners = config->shared ? (size_t)node.count : (size_t)world_size;
+    size_t me = config->shared ? (size_t)node.id : (size_t)world_rank;
+
+    if(!config->file2)
+    {
+      mat_init_panels(mat2, n, w, panel, me, owners);
+    }
+    else if(mat_file_panels(config->file2,
+          config->shared ? node.leaders : MPI_COMM_WORLD, mat2, n, w, panel,
+          me, owners) != 0)
+    {
+      fprintf(stderr, "Failed to read %s\n", config->file2);
+      MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+  }
+
+  if(config->shared)
+  {
+    mat_node_sync(&node);
+  }
+
+  MPI_Barrier(MPI_COMM_WORLD);
+  end = MPI_Wtime();
+
+  if(world_rank == 0)
+  {
+    if(config->print_matrix)
+    {
+      /* whole matrixes only exist on root to be printed */
+      mat_elem_t* full1 = mat_alloc(m * w);
+      mat_elem_t* full2 = mat_alloc(w * n);
+
+      if(!full1 || !full2)
+      {
+        perror("malloc");
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+      }
+
+      mat_init(full1, full2, m, n, w);
+
+      if((config->file1 && mat_file_rows(config->file1, MPI_COMM_SELF, full1,
+              0, m, w, 0) != 0) ||
+          (config->file2 && mat_file_rows(config->file2, MPI_COMM_SELF, full2,
+              0, w, n, 0) != 0))
+      {
+        fprintf(stderr, "Failed to read input files\n");
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+      }
+
+      fprintf(stdout, "Matrix 1:\n");
+      mat_print(full1, m, w);
+      fprintf(stdout, "Matrix 2:\n");
+      mat_print(full2, w, n);
+      free(full1);
+      free(full2);
+    }
+
+    if(config->file1 || config->file2)
+    {
+      fprintf(stdout, "Read: %f ms\n", (end - start) * 1000);
+    }
+
+    fprintf(stdout, "Compute with %zu MPI node(s) with %zu thread(s) \n",
+        (size_t)world_size, config->threads);
+  }
+
+  if(config->transpose)
+  {
+    /* transposed panels are broadcast instead of second matrix ones
+     * (leader transposes panels of node), see mat_transpose.h
+     */
+    size_t owners = config->shared ? (size_t)node.count : (size_t)world_size;
+    size_t me = config->shared ? (size_t)node.id : (size_t)world_rank;
+    int transpose = !config->shared || node.rank == 0;
+
+    mat2t = config->shared ? &mat2[panels_size] : mat_alloc(panels_size + 1);
+
+    if(!mat2t)
+    {
+      perror("malloc");
+      MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    start = MPI_Wtime();
+
+    for(size_t p = me ; transpose && p * panel < n ; p += owners)
+    {
+      size_t nb = p * panel + panel < n ? panel : n - p * panel;
+      size_t offset = p / owners * panel * w;
+
+      mat_transpose_mpi(&mat2[offset], &mat2t[offset], nb, w,
+          config->threads);
+    }
+
+    if(config->shared)
+    {
+      mat_node_sync(&node);
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    end = MPI_Wtime();
+
+    if(world_rank == 0)
+    {
+      fprintf(stdout, "Transpose: %f ms\n", (end - start) * 1000);
+    }
+  }
+
+  MPI_Barrier(MPI_COMM_WORLD);
+  start = MPI_Wtime();
+  if((config->algorithm == MAT_RMA ?
+        mat_mult_rma(mat1, mat2t ? mat2t : mat2, res, result, n, w, counts,
+          displs, world_rank, world_size, config->threads, config->transpose,
+          panel, config->gather) :
+        mat_mult_mpi(mat1, mat2t ? mat2t : mat2, res, result, n, w, counts,
+          displs, world_rank, world_size, config->threads, config->transpose,
+          panel, config->gather, config->shared ? &node : NULL)) == -1)
+  {
+    fprintf(stderr, "Matrixes cannot be multiplied\n");
+    ret = EXIT_FAILURE;
+  }
+  else
+  {
+    end = MPI_Wtime();
+
+    if(world_rank == 0)
+    {
+      fprintf(stdout, "Multiplication success: %f ms\n", (end - start) * 1000);
+
+      if(config->print_matrix)
+      {
+        mat_print(result, m, n);
+      }
+    }
+  }
+
+  if(ret == EXIT_SUCCESS && config->result_file)
+  {
+    start = MPI_Wtime();
+
+    if(mat_file_rows(config->result_file, MPI_COMM_WORLD, res,
+          displs[world_rank], rows, n, 1) != 0)
+    {
+      fprintf(stderr, "Failed to write %s\n", config->result_file);
+      ret = EXIT_FAILURE;
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    end = MPI_Wtime();
+
+    if(world_rank == 0)
+    {
+      fprintf(stdout, "Write: %f ms\n", (end - start) * 1000);
+    }
+  }
+
+  if(res != result)
+  {
+    free(res);
+  }
+  free(result);
+  free(mat1);
+
+  if(config->shared)
+  {
+    mat_node_destroy(&node);
+  }
+  else
   {
-    mat1[i] = i;
-    mat2[i] = i;
+    free(mat2);
+    free(mat2t);
   }
+  free(weights);
+  free(counts);
+  free(displs);
+  return ret;
 }
 
 /**
- * \brief Print the matrix content on stdout.
- * \param mat the matrix.
- * \param m row size of the matrix.
- * \param n column size of the matrix.
+ * \brief Runs an algorithm on a 2D grid of blocks: each process initializes
+ * and holds only its blocks of the three matrixes. Result is gathered on
+ * rank 0 only if requested (input matrixes to be printed).
+ * \param config configuration.
+ * \param world_rank MPI rank.
+ * \param world_size Total number of MPI nodes.
+ * \return EXIT_SUCCESS or EXIT_FAILURE.
  */
-void mat_print(uint64_t * mat, size_t m, size_t n)
+int mat_run_grid(const struct configuration* config, int world_rank,
+    int world_size)
 {
-  for(size_t i = 0 ; i < m ; i++)
+  struct mat_grid grid;
+  mat_elem_t* a = NULL;
+  mat_elem_t* b = NULL;
+  mat_elem_t* c = NULL;
+  mat_elem_t* mat = NULL;
+  size_t m = config->m;
+  size_t n = config->n;
+  size_t w = config->w;
+  size_t max_rows = 0;
+  size_t max_cols = 0;
+  double start = 0;
+  double end = 0;
+  int ret = EXIT_SUCCESS;
+
+  if(world_size % config->layers)
   {
-    for(size_t j = 0 ; j < n ; j++)
+    if(world_rank == 0)
     {
-      fprintf(stdout, "%lu ", mat[i * m + j]);
+      fprintf(stderr, "Number of processes (%d) is not a multiple of layers "
+          "(%zu)\n", world_size, config->layers);
     }
-    fprintf(stdout, "\n");
+
+    return EXIT_FAILURE;
   }
-}
 
-/**
- * \brief Performs multiplication of matrixes.
- * \param mat1 first matrix.
- * \param mat2 second matrix.
- * \param result result matrix.
- * \param m row size of first matrix.
- * \param n column size of first matrix.
- * \param w row size of second matrix.
- * \param rank MPI rank.
- * \param world_size Total number of MPI nodes.
- * \param threads number of threads to use (OpenMP only).
- * \return 0 if success, -1 if matrixes cannot be multiplied.
- */
-int mat_mult_mpi(uint64_t* mat1, uint64_t* mat2, uint64_t* result, size_t m,
-    size_t n, size_t w, size_t rank, size_t world_size, size_t threads)
-{
-  int nb_elements = m * n;
-  int nb_subelements = nb_elements / world_size;
-  uint64_t* res = malloc(sizeof(uint64_t) * nb_subelements);
+  if(mat_grid_init(&grid, world_size, config->algorithm == MAT_CANNON,
+        config->layers) != 0)
+  {
+    fprintf(stderr, "Failed to create process grid\n");
+    return EXIT_FAILURE;
+  }
 
-  (void)rank;
-  (void)threads;
+  if(config->algorithm == MAT_CANNON && grid.dims[0] != grid.dims[1])
+  {
+    if(world_rank == 0)
+    {
+      fprintf(stderr, "Cannon requires a square number of processes (%d)\n",
+          world_size);
+    }
+
+    mat_grid_destroy(&grid);
+    return EXIT_FAILURE;
+  }
 
-  if(n != w || !res)
+  /* blocks of A (m x w), B (w x n) and C (m x n), largest dimensions over
+   * the grid plus one element so that empty blocks can be allocated
+   */
+  max_rows = (m > w ? m : w) / grid.dims[0] + 1;
+  max_cols = (n > w ? n : w) / grid.dims[1] + 1;
+  a = mat_alloc(max_rows * max_cols);
+  b = mat_alloc(max_rows * max_cols);
+  c = mat_alloc(max_rows * max_cols);
+
+  if(world_rank == 0 && config->gather)
   {
-    return -1;
+    size_t max = m * w > w * n ? m * w : w * n;
+
+    mat = mat_alloc(max > m * n ? max : m * n);
+  }
+
+  if(!a || !b || !c || (world_rank == 0 && config->gather && !mat))
+  {
+    perror("malloc");
+    MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
   }
 
-  /* transmit row to each process */
-  MPI_Scatter(mat1, nb_subelements, MPI_UINT64_T, mat1, nb_subelements,
-      MPI_UINT64_T, 0 /* rank root */, MPI_COMM_WORLD);
+  MPI_Barrier(MPI_COMM_WORLD);
+  start = MPI_Wtime();
 
-  /* broadcast second matrix to other nodes */
-  MPI_Bcast(mat2, nb_elements, MPI_UINT64_T, 0, MPI_COMM_WORLD);
+  /* other layers receive copies of the blocks of first layer */
+  if((config->file1 && mat_file_block(config->file1, a, m, w, &grid, 0) != 0) ||
+      (config->file2 && mat_file_block(config->file2, b, w, n, &grid, 0) != 0))
+  {
+    fprintf(stderr, "Failed to read input files\n");
+    MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+  }
 
-	/* matrix multiply */
+  if(grid.coords[2] == 0)
+  {
+    if(!config->file1)
+    {
+      mat_init_block(a, m, w, &grid);
+    }
 
-#if _OPENMP
-  /* to set spread way, add to next line: proc_bind(spread) */
-  #pragma omp parallel num_threads(threads)
-#endif
-  for(size_t i = 0 ; i < (m / world_size) ; i++)
+    if(!config->file2)
+    {
+      mat_init_block(b, w, n, &grid);
+    }
+  }
+
+  MPI_Barrier(MPI_COMM_WORLD);
+  end = MPI_Wtime();
+
+  if(world_rank == 0 && (config->file1 || config->file2))
   {
-#if _OPENMP
-    #pragma omp for schedule(static)
-#endif
-    for(size_t j = 0 ; j < n ; j++)
+    fprintf(stdout, "Read: %f ms\n", (end - start) * 1000);
+  }
+
+  if(config->print_matrix && grid.coords[2] == 0)
+  {
+    mat_gather_blocks(a, mat, m, w, &grid);
+
+    if(world_rank == 0)
     {
-      uint64_t tmp = 0;
+      fprintf(stdout, "Matrix 1:\n");
+      mat_print(mat, m, w);
+    }
 
-      for(size_t k = 0 ; k < w ; k++)
-      {
-        tmp += mat1[i * w + k] * mat2[k * n + j];
-      }
+    mat_gather_blocks(b, mat, w, n, &grid);
 
-      res[i * m + j] = tmp;
+    if(world_rank == 0)
+    {
+      fprintf(stdout, "Matrix 2:\n");
+      mat_print(mat, w, n);
     }
   }
 
-  MPI_Gather(res, nb_subelements, MPI_UINT64_T, result, nb_subelements,
-      MPI_UINT64_T, 0, MPI_COMM_WORLD);
+  if(world_rank == 0)
+  {
+    fprintf(stdout, "Compute with %zu MPI node(s) (%dx%dx%d grid) with %zu "
+        "thread(s) \n", (size_t)world_size, grid.dims[0], grid.dims[1],
+        grid.dims[2], config->threads);
+  }
 
-  free(res);
   MPI_Barrier(MPI_COMM_WORLD);
-  return 0;
-}
+  start = MPI_Wtime();
 
-/**
- * \brief Print help.
- * \param program program name.
- */
-void print_help(const char* program)
-{
-  fprintf(stdout, "Usage: %s [-m row size] "
-#ifdef _OPENMP
-      "[-t thread_number]"
-#endif
-      "[-p] [-h]\n\n"
-      "  -h\t\tDisplay this help\n"
-#ifdef _OPENMP
-      "  -t nb\t\tDefines number of threads to use\n"
-#endif
-      "  -p\t\tPrint the input and output matrixes\n"
-      "  -m row\tRow/column size (default 1024)\n",
-      program);
-}
+  switch(config->algorithm)
+  {
+    case MAT_CANNON:
+      ret = mat_mult_cannon(a, b, c, m, n, w, &grid, config->threads);
+      break;
+    case MAT_25D:
+      ret = mat_mult_25d(a, b, c, m, n, w, &grid, config->panel,
+          config->threads);
+      break;
+    case MAT_SUMMA:
+    default:
+      ret = mat_mult_summa(a, b, c, m, n, w, 0, w, &grid, config->panel,
+          config->threads);
+      break;
+  }
 
-/**
- * \brief Parse command line.
- * \param argc number of arguments.
- * \param argv array of arguments.
- * \param configuration configuration parameters.
- * \return 0 to exit with success, -1 to exit with error, otherwise continue.
- */
-int parse_cmdline(int argc, char** argv,
-    struct configuration* configuration)
-{
-  /*
-   * h: print help and exit
-   * p: print input and output matrixes
-   * m: row size
-   * t: number of threads to use
-   */
-  static const char* options = "hpm:t:";
-  int opt = 0;
-  int print_matrix = 0;
-  long m = DEFAULT_ROW_SIZE;
-  int threads = sysconf(_SC_NPROCESSORS_ONLN);
-  int ret = 1;
+  if(ret == -1)
+  {
+    fprintf(stderr, "Matrixes cannot be multiplied\n");
+    MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+  }
 
-  assert(configuration);
+  MPI_Barrier(MPI_COMM_WORLD);
+  end = MPI_Wtime();
 
-  while((opt = getopt(argc, argv, options)) != -1)
+  if(world_rank == 0)
   {
-    switch(opt)
+    fprintf(stdout, "Multiplication success: %f ms\n", (end - start) * 1000);
+  }
+
+  ret = EXIT_SUCCESS;
+
+  if(config->gather && grid.coords[2] == 0)
+  {
+    start = MPI_Wtime();
+    mat_gather_blocks(c, mat, m, n, &grid);
+    end = MPI_Wtime();
+
+    if(world_rank == 0)
     {
-      case 'h':
-        /* help */
-        print_help(argv[0]);
-        return 0;
-        break;
-      case 'p':
-        print_matrix = 1;
-        break;
-      case 'm':
-        m = atol(optarg);
-        if(m < 2)
-        {
-          fprintf(stderr, "Bad argument for '-m' %ld\n", m);
-          ret = -1;
-        }
-        break;
-      case 't':
-        threads = atol(optarg);
-        if(threads <= 0)
-        {
-          fprintf(stderr, "Bad argument for '-t': %s\n", optarg);
-          ret = EXIT_FAILURE;
-        }
-        break;
-      default:
-        fprintf(stderr, "Bad option (%c)\n", optopt);
-        ret = -1;
-        break;
+      fprintf(stdout, "Gather: %f ms\n", (end - start) * 1000);
+
+      if(config->print_matrix)
+      {
+        mat_print(mat, m, n);
+      }
     }
   }
 
-  configuration->print_matrix = print_matrix;
-  configuration->m = m;
-#ifdef _OPENMP
-  configuration->threads = threads;
-#else
-  configuration->threads = 1;
-#endif
+  if(config->result_file)
+  {
+    start = MPI_Wtime();
+
+    if(mat_file_block(config->result_file, c, m, n, &grid, 1) != 0)
+    {
+      fprintf(stderr, "Failed to write %s\n", config->result_file);
+      ret = EXIT_FAILURE;
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    end = MPI_Wtime();
 
+    if(world_rank == 0)
+    {
+      fprintf(stdout, "Write: %f ms\n", (end - start) * 1000);
+    }
+  }
+
+  free(a);
+  free(b);
+  free(c);
+  free(mat);
+  mat_grid_destroy(&grid);
   return ret;
 }
 
@@ -261,22 +2354,12 @@ int parse_cmdline(int argc, char** argv,
  */
 int main(int argc, char** argv)
 {
-  uint64_t* mat1 = NULL;
-  uint64_t* mat2 = NULL;
-  uint64_t* mat3 = NULL;
-  size_t m = DEFAULT_ROW_SIZE;
-  size_t n = DEFAULT_COLUMN_SIZE;
-  size_t w = DEFAULT_COLUMN_SIZE;
-  int print_matrix = 0;
   struct configuration config;
-  double start = 0;
-  double end = 0;
   int ret = 0;
   int world_size = 0;
   int world_rank = 0;
   char processor_name[MPI_MAX_PROCESSOR_NAME];
   int name_len = 0;
-  size_t nb_elements = 0;
 
   ret = parse_cmdline(argc, argv, &config);
 
@@ -289,13 +2372,6 @@ int main(int argc, char** argv)
     exit(EXIT_FAILURE);
   }
 
-  m = config.m;
-  n = config.m;
-  w = config.m;
-  print_matrix = config.print_matrix;
-
-  nb_elements = m * n;
-
   /* MPI initialization */
 #if _OPENMP
   int required = MPI_THREAD_SERIALIZED;
@@ -325,83 +2401,24 @@ int main(int argc, char** argv)
   MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
   MPI_Get_processor_name(processor_name, &name_len);
 
-  if(m % world_size)
-  {
-    if(world_rank == 0)
-    {
-      fprintf(stderr,
-          "Matrix size (%zu) not divisible by number of processor (%d)\n",
-          nb_elements,
-          world_size);
-    }
-
-    MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
-  }
-
   fprintf(stdout, "MPI from processor %s, rank %d out of %d\n",
       processor_name, world_rank, world_size);
 
-  mat1 = malloc(nb_elements * sizeof(uint64_t));
-  mat2 = malloc(nb_elements * sizeof(uint64_t));
-  mat3 = malloc(nb_elements * sizeof(uint64_t));
-
-  if(!mat1 || !mat2 || !mat3)
-  {
-    perror("malloc");
-    free(mat1);
-    free(mat2);
-    free(mat3);
-
-    MPI_Finalize();
-    exit(EXIT_FAILURE);
-  }
-
-  if(world_rank == 0)
-  {
-    mat_init(mat1, mat2, m, n);
-
-    if(print_matrix)
-    {
-      fprintf(stdout, "Matrix 1:\n");
-      mat_print(mat1, m, n);
-      fprintf(stdout, "Matrix 2:\n");
-      mat_print(mat2, m, n);
-    }
-
-    fprintf(stdout, "Compute with %zu MPI node(s) with %zu thread(s) \n",
-        (size_t)world_size, config.threads);
-  }
-
-  start = MPI_Wtime();
-  if(mat_mult_mpi(mat1, mat2, mat3, m, n, w, world_rank, world_size,
-        config.threads) == -1)
-  {
-    fprintf(stderr, "Matrixes cannot be multiplied\n");
-    ret = EXIT_FAILURE;
-  }
-  else
+  switch(config.algorithm)
   {
-    end = MPI_Wtime();
-
-    if(world_rank == 0)
-    {
-      fprintf(stdout, "Multiplication success: %f ms\n", (end - start) * 1000);
-
-      if(print_matrix)
-      {
-        mat_print(mat3, m, n);
-      }
-    }
-    ret = EXIT_SUCCESS;
+    case MAT_SUMMA:
+    case MAT_CANNON:
+    case MAT_25D:
+      ret = mat_run_grid(&config, world_rank, world_size);
+      break;
+    case MAT_ROWS:
+    case MAT_RMA:
+    default:
+      ret = mat_run_rows(&config, world_rank, world_size);
+      break;
   }
 
-  /* free resources */
-  free(mat1);
-  free(mat2);
-  free(mat3);
-
   MPI_Finalize();
 
   return ret;
 }
-
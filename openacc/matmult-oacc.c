@@ -41,14 +41,29 @@ static const size_t DEFAULT_COLUMN_SIZE = 1024;
 struct configuration
 {
   /**
-   * \brief Row/column size.
+   * \brief Row size of first matrix.
    */
   size_t m;
 
+  /**
+   * \brief Column size of second matrix.
+   */
+  size_t n;
+
+  /**
+   * \brief Common dimension (column size of first matrix).
+   */
+  size_t w;
+
   /**
    * \brief Print input and output matrixes.
    */
   int print_matrix;
+
+  /**
+   * \brief Transpose second matrix before multiplication.
+   */
+  int transpose;
 };
 
 /**
@@ -62,18 +77,35 @@ static double util_gettime_us(void)
     return t.tv_sec * 1000000 + t.tv_usec;
 }
 
+/**
+ * \brief Allocates a matrix aligned on a cache line (64 bytes). It is freed
+ * with free().
+ * \param nb number of elements.
+ * \return matrix or NULL if allocation fails.
+ */
+static uint64_t* mat_alloc(size_t nb)
+{
+  /* aligned_alloc requires size to be a multiple of alignment */
+  return aligned_alloc(64, (nb * sizeof(uint64_t) + 63) & ~(size_t)63);
+}
+
 /**
  * \brief Initializes the matrixes.
  * \param mat1 first matrix.
  * \param mat2 second matrix.
- * \param m row size of the matrix.
- * \param n column size of the matrix.
+ * \param m row size of first matrix.
+ * \param n column size of second matrix.
+ * \param w column size of first matrix.
  */
-void mat_init(uint64_t* mat1, uint64_t* mat2, size_t m, size_t n)
+void mat_init(uint64_t* mat1, uint64_t* mat2, size_t m, size_t n, size_t w)
 {
-  for(size_t i = 0 ; i < (m * n) ; i++)
+  for(size_t i = 0 ; i < (m * w) ; i++)
   {
     mat1[i] = i;
+  }
+
+  for(size_t i = 0 ; i < (w * n) ; i++)
+  {
     mat2[i] = i;
   }
 }
@@ -90,7 +122,7 @@ void mat_print(uint64_t* mat, size_t m, size_t n)
   {
     for(size_t j = 0 ; j < n ; j++)
     {
-      fprintf(stdout, "%lu ", mat[i * m + j]);
+      fprintf(stdout, "%lu ", mat[i * n + j]);
     }
     fprintf(stdout, "\n");
   }
@@ -102,23 +134,88 @@ void mat_print(uint64_t* mat, size_t m, size_t n)
  * \param mat2 second matrix.
  * \param result result matrix.
  * \param m row size of first matrix.
- * \param n column size of first matrix.
- * \param w row size of second matrix.
- * \return 0 if success, -1 if matrixes cannot be multiplied.
+ * \param n column size of second matrix.
+ * \param w column size of first matrix.
+ * \return 0.
  */
-int mat_mult_oacc(uint64_t* mat1, uint64_t* mat2, uint64_t* result, size_t m,
+int mat_mult_oacc(const uint64_t* restrict mat1,
+    const uint64_t* restrict mat2, uint64_t* restrict result, size_t m,
     size_t n, size_t w)
 {
   size_t i = 0;
   size_t j = 0;
   size_t k = 0;
 
-  if(n != w)
+  #pragma acc parallel copyin(mat1[0:(m * w)],mat2[0:(w * n)]) copyout(result[0:(m * n)])
+  {
+    #pragma acc loop independent
+    for(i = 0 ; i < m ; i++)
+    {
+      #pragma acc loop independent
+      for(j = 0 ; j < n ; j++)
+      {
+        uint64_t tmp = 0;
+
+        #pragma acc loop independent reduction(+:tmp)
+        for(k = 0 ; k < w ; k++)
+        {
+          tmp += mat1[i * w + k] * mat2[k * n + j];
+        }
+
+        result[i * n + j] = tmp;
+      }
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * \brief Transposes second matrix on the accelerator.
+ * \param mat2 second matrix (w x n).
+ * \param mat2t transposed second matrix (n x w).
+ * \param n column size of second matrix.
+ * \param w row size of second matrix.
+ * \return 0.
+ */
+int mat_transpose_oacc(const uint64_t* restrict mat2,
+    uint64_t* restrict mat2t, size_t n, size_t w)
+{
+  size_t k = 0;
+  size_t j = 0;
+
+  #pragma acc parallel loop collapse(2) independent copyin(mat2[0:(w * n)]) copyout(mat2t[0:(n * w)])
+  for(k = 0 ; k < w ; k++)
   {
-    return -1;
+    for(j = 0 ; j < n ; j++)
+    {
+      mat2t[j * w + k] = mat2[k * n + j];
+    }
   }
 
-  #pragma acc parallel copyin(mat1[0:(m * n)],mat2[0:(n * w)]) copyout(result[0:(n * w)])
+  return 0;
+}
+
+/**
+ * \brief Performs multiplication of matrixes with transposed second matrix,
+ * each element of result is a dot product of two contiguous rows.
+ * \param mat1 first matrix.
+ * \param mat2t transposed second matrix (n x w).
+ * \param result result matrix.
+ * \param m row size of first matrix.
+ * \param n column size of second matrix.
+ * \param w column size of first matrix.
+ * \return 0.
+ */
+int mat_mult_oacc_transposed(const uint64_t* restrict mat1,
+    const uint64_t* restrict mat2t, uint64_t* restrict result, size_t m,
+    size_t n, size_t w)
+{
+  size_t i = 0;
+  size_t j = 0;
+  size_t k = 0;
+
+  #pragma acc parallel copyin(mat1[0:(m * w)],mat2t[0:(n * w)]) copyout(result[0:(m * n)])
   {
     #pragma acc loop independent
     for(i = 0 ; i < m ; i++)
@@ -131,10 +228,10 @@ int mat_mult_oacc(uint64_t* mat1, uint64_t* mat2, uint64_t* result, size_t m,
         #pragma acc loop independent reduction(+:tmp)
         for(k = 0 ; k < w ; k++)
         {
-          tmp += mat1[i * w + k] * mat2[k * n + j];
+          tmp += mat1[i * w + k] * mat2t[j * w + k];
         }
 
-        result[i * m + j] = tmp;
+        result[i * n + j] = tmp;
       }
     }
   }
@@ -148,11 +245,15 @@ int mat_mult_oacc(uint64_t* mat1, uint64_t* mat2, uint64_t* result, size_t m,
  */
 void print_help(const char* program)
 {
-  fprintf(stdout, "Usage: %s [-m row size] [-t nb] "
-      "[-p] [-h]\n\n"
+  fprintf(stdout, "Usage: %s [-m size] [-M rows] [-K common] [-N columns] "
+      "[-T] [-p] [-h]\n\n"
       "  -h\t\tDisplay this help\n"
+      "  -T\t\tTranspose second matrix before multiplication\n"
       "  -p\t\tPrint the input and output matrixes\n"
-      "  -m row\tRow/column size (default 1024)\n", program);
+      "  -m size\tSize of square matrixes (default 1024)\n"
+      "  -M rows\tRow size of first matrix (default -m)\n"
+      "  -K common\tColumn size of first matrix (default -m)\n"
+      "  -N columns\tColumn size of second matrix (default -m)\n", program);
 }
 
 /**
@@ -168,13 +269,18 @@ int parse_cmdline(int argc, char** argv,
   /*
    * h: print help and exit
    * p: print input and output matrixes
-   * m: row size
-   * n: column size
+   * m: square size
+   * M: row size of first matrix
+   * K: common dimension
+   * N: column size of second matrix
+   * T: transpose second matrix
    */
-  static const char* options = "hpm:t:";
+  static const char* options = "hpm:M:K:N:T";
   int opt = 0;
   int print_matrix = 0;
   long m = DEFAULT_ROW_SIZE;
+  long dims[3] = {0, 0, 0};
+  int transpose = 0;
   int ret = 1;
 
   assert(configuration);
@@ -199,6 +305,19 @@ int parse_cmdline(int argc, char** argv,
           ret = -1;
         }
         break;
+      case 'M':
+      case 'K':
+      case 'N':
+        dims[opt == 'M' ? 0 : opt == 'K' ? 1 : 2] = atol(optarg);
+        if(atol(optarg) < 1)
+        {
+          fprintf(stderr, "Bad argument for '-%c': %s\n", opt, optarg);
+          ret = -1;
+        }
+        break;
+      case 'T':
+        transpose = 1;
+        break;
       default:
         fprintf(stderr, "Bad option (%c)\n", optopt);
         ret = -1;
@@ -207,7 +326,10 @@ int parse_cmdline(int argc, char** argv,
   }
 
   configuration->print_matrix = print_matrix;
-  configuration->m = m;
+  configuration->transpose = transpose;
+  configuration->m = dims[0] ? (size_t)dims[0] : (size_t)m;
+  configuration->w = dims[1] ? (size_t)dims[1] : (size_t)m;
+  configuration->n = dims[2] ? (size_t)dims[2] : (size_t)m;
 
   return ret;
 }
@@ -222,6 +344,7 @@ int main(int argc, char** argv)
 {
   uint64_t* mat1 = NULL;
   uint64_t* mat2 = NULL;
+  uint64_t* mat2t = NULL;
   uint64_t* mat3 = NULL;
   size_t m = DEFAULT_ROW_SIZE;
   size_t n = DEFAULT_COLUMN_SIZE;
@@ -249,14 +372,14 @@ int main(int argc, char** argv)
   }
 
   m = config.m;
-  n = config.m;
-  w = config.m;
+  n = config.n;
+  w = config.w;
   print_matrix = config.print_matrix;
 
   nb_elements = m * n;
-  mat1 = malloc(nb_elements * sizeof(uint64_t));
-  mat2 = malloc(nb_elements * sizeof(uint64_t));
-  mat3 = malloc(nb_elements * sizeof(uint64_t));
+  mat1 = mat_alloc(m * w);
+  mat2 = mat_alloc(w * n);
+  mat3 = mat_alloc(nb_elements);
 
   if(!mat1 || !mat2 || !mat3)
   {
@@ -267,18 +390,38 @@ int main(int argc, char** argv)
     exit(EXIT_FAILURE);
   }
 
-  mat_init(mat1, mat2, m, n);
+  mat_init(mat1, mat2, m, n, w);
 
   if(print_matrix)
   {
     printf("Matrix 1:\n");
-    mat_print(mat1, m, n);
+    mat_print(mat1, m, w);
     printf("Matrix 2:\n");
-    mat_print(mat2, m, n);
+    mat_print(mat2, w, n);
+  }
+
+  if(config.transpose)
+  {
+    mat2t = mat_alloc(w * n);
+
+    if(!mat2t)
+    {
+      perror("malloc");
+      free(mat1);
+      free(mat2);
+      free(mat3);
+      exit(EXIT_FAILURE);
+    }
+
+    start = util_gettime_us();
+    mat_transpose_oacc(mat2, mat2t, n, w);
+    end = util_gettime_us();
+    fprintf(stdout, "Transpose: %f ms\n", (end - start) / 1000);
   }
 
   start = util_gettime_us();
-  if(mat_mult_oacc(mat1, mat2, mat3, m, n, w) == -1)
+  if((mat2t ? mat_mult_oacc_transposed(mat1, mat2t, mat3, m, n, w) :
+        mat_mult_oacc(mat1, mat2, mat3, m, n, w)) == -1)
   {
     fprintf(stderr, "Matrixes cannot be multiplied\n");
     ret = EXIT_FAILURE;
@@ -299,6 +442,7 @@ int main(int argc, char** argv)
   /* free resources */
   free(mat1);
   free(mat2);
+  free(mat2t);
   free(mat3);
 
   return ret;
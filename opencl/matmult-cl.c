@@ -22,6 +22,7 @@
 #include <sys/time.h>
 
 #include "util_opencl.h"
+#include "mat_type.h"
 
 /**
  * \brief Default row size.
@@ -33,6 +34,31 @@ static const size_t DEFAULT_ROW_SIZE = 1024;
  */
 static const size_t DEFAULT_COLUMN_SIZE = 1024;
 
+/**
+ * \brief Work-group size in each dimension (BLOCK_SIZE of kernels).
+ */
+static const size_t WORK_GROUP_SIZE = 16;
+
+/**
+ * \brief Default side of the tile of result computed by a work-item of
+ * matmult_tiled kernel.
+ */
+static const size_t DEFAULT_TILE_SIZE = 4;
+
+/**
+ * \brief Default directory of cached program binaries.
+ */
+static const char* DEFAULT_CACHE_DIR = ".";
+
+/**
+ * \brief Build options of OpenCL program, they set the element type.
+ */
+static const char* CL_BUILD_OPTIONS = "-DMAT_ELEM=" MAT_ELEM_CL
+#if MAT_TYPE == MAT_DOUBLE
+  " -DMAT_ELEM_FP64"
+#endif
+  ;
+
 /**
  * \struct configuration
  * \brief Configuration.
@@ -40,14 +66,35 @@ static const size_t DEFAULT_COLUMN_SIZE = 1024;
 struct configuration
 {
   /**
-   * \brief Row/column size.
+   * \brief Row size of first matrix.
    */
   size_t m;
 
+  /**
+   * \brief Column size of second matrix.
+   */
+  size_t n;
+
+  /**
+   * \brief Common dimension (column size of first matrix).
+   */
+  size_t w;
+
   /**
    * \brief Print input and output matrixes.
    */
   int print_matrix;
+
+  /**
+   * \brief Directory of cached program binaries (NULL to always build).
+   */
+  const char* cache_dir;
+
+  /**
+   * \brief Side of the tile of result computed by a work-item of
+   * matmult_tiled kernel.
+   */
+  size_t tile;
 };
 
 /**
@@ -65,15 +112,21 @@ static double util_gettime_us(void)
  * \brief Initializes the matrixes.
  * \param mat1 first matrix.
  * \param mat2 second matrix.
- * \param m row size of the matrix.
- * \param n column size of the matrix.
+ * \param m row size of first matrix.
+ * \param n column size of second matrix.
+ * \param w column size of first matrix.
  */
-void mat_init(cl_ulong* mat1, cl_ulong* mat2, size_t m, size_t n)
+void mat_init(mat_elem_t* mat1, mat_elem_t* mat2, size_t m, size_t n,
+    size_t w)
 {
-  for(size_t i = 0 ; i < (m * n) ; i++)
+  for(size_t i = 0 ; i < (m * w) ; i++)
+  {
+    mat1[i] = MAT_ELEM_INIT(i);
+  }
+
+  for(size_t i = 0 ; i < (w * n) ; i++)
   {
-    mat1[i] = i;
-    mat2[i] = i;
+    mat2[i] = MAT_ELEM_INIT(i);
   }
 }
 
@@ -83,13 +136,13 @@ void mat_init(cl_ulong* mat1, cl_ulong* mat2, size_t m, size_t n)
  * \param m row size of the matrix.
  * \param n column size of the matrix.
  */
-void mat_print(cl_ulong* mat, size_t m, size_t n)
+void mat_print(mat_elem_t* mat, size_t m, size_t n)
 {
   for(size_t i = 0 ; i < m ; i++)
   {
     for(size_t j = 0 ; j < n ; j++)
     {
-      fprintf(stdout, "%lu ", mat[i * m + j]);
+      fprintf(stdout, MAT_ELEM_FMT " ", mat[i * n + j]);
     }
     fprintf(stdout, "\n");
   }
@@ -101,13 +154,16 @@ void mat_print(cl_ulong* mat, size_t m, size_t n)
  * \param mat2 second matrix.
  * \param result result matrix.
  * \param M row size of first matrix.
- * \param N column size of first matrix.
- * \param W row size of second matrix.
- * \return 0 if success, -1 if matrixes cannot be multiplied or some OpenCL
- * blocking errors.
+ * \param N column size of second matrix.
+ * \param W column size of first matrix.
+ * \param tile side of the tile of result computed by a work-item of
+ * matmult_tiled kernel.
+ * \param cache_dir directory of cached program binaries (NULL to always
+ * build program from source).
+ * \return 0 if success, -1 if some OpenCL blocking errors.
  */
-int mat_mult_cl(cl_ulong* mat1, cl_ulong* mat2, cl_ulong* result, size_t M,
-    size_t N, size_t W)
+int mat_mult_cl(mat_elem_t* mat1, mat_elem_t* mat2, mat_elem_t* result,
+    size_t M, size_t N, size_t W, size_t tile, const char* cache_dir)
 {
   int ret = 0;
   cl_platform_id* platforms = NULL;
@@ -116,6 +172,13 @@ int mat_mult_cl(cl_ulong* mat1, cl_ulong* mat2, cl_ulong* result, size_t M,
   double start = 0;
   double end = 0;
   int success = 0;
+  /* kernels take 32-bit sizes */
+  cl_uint sizes[3] = {M, N, W};
+  /* tile of matmult_tiled is set at compile time */
+  char options[256];
+
+  snprintf(options, sizeof(options), "%s -DTILE_M=%zu -DTILE_N=%zu",
+      CL_BUILD_OPTIONS, tile, tile);
 
   if((nb_platforms = opencl_get_platforms(&platforms, &status)) <= 0)
   {
@@ -132,8 +195,10 @@ int mat_mult_cl(cl_ulong* mat1, cl_ulong* mat2, cl_ulong* result, size_t M,
     cl_program program;
     cl_kernel* kernels = NULL;
     int nb_kernels = 0;
+    int cached = 0;
     cl_mem input_mat1;
     cl_mem input_mat2;
+    cl_mem input_mat2t;
     cl_mem output_result;
     cl_context_properties context_props[] =
       {CL_CONTEXT_PLATFORM, (cl_context_properties)platforms[i], 0};
@@ -158,11 +223,16 @@ int mat_mult_cl(cl_ulong* mat1, cl_ulong* mat2, cl_ulong* result, size_t M,
       continue;
     }
 
-    /* get the OpenCL program from the file and build it */
-    if((ret = opencl_get_program_from_file(context, "./matmult-cl.cl", &program,
-          &status)) != 0)
+    /* get the OpenCL program from the cache or build it from the file */
+    start = util_gettime_us();
+    ret = opencl_build_program_cached(context, nb_devices, devices,
+        "./matmult-cl.cl", options, cache_dir, &program, &cached,
+        &status);
+    end = util_gettime_us();
+
+    if(ret != 0 && !program)
     {
-      fprintf(stderr, "opencl_get_program_from_file: error:%d status=%d\n",
+      fprintf(stderr, "opencl_build_program_cached: error:%d status=%d\n",
           ret, status);
 
       clReleaseContext(context);
@@ -170,8 +240,7 @@ int mat_mult_cl(cl_ulong* mat1, cl_ulong* mat2, cl_ulong* result, size_t M,
       continue;
     }
 
-    if((status = clBuildProgram(program, nb_devices, devices, NULL, NULL,
-            NULL)) != CL_SUCCESS)
+    if(ret != 0)
     {
       cl_build_status build_status;
 
@@ -211,6 +280,10 @@ int mat_mult_cl(cl_ulong* mat1, cl_ulong* mat2, cl_ulong* result, size_t M,
       continue;
     }
 
+    fprintf(stdout, "Program %s in %f ms\n",
+        cached ? "loaded from cache" : "built from source",
+        (end - start) / 1000);
+
     /* retrieves kernels from program */
     if((nb_kernels = opencl_get_kernels(program, &kernels, &status)) <= 0)
     {
@@ -248,32 +321,92 @@ int mat_mult_cl(cl_ulong* mat1, cl_ulong* mat2, cl_ulong* result, size_t M,
 
       /* creates the different OpenCL buffer */
       input_mat1 = clCreateBuffer(context,
-          CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, M * N * sizeof(cl_ulong),
+          CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, M * W * sizeof(mat_elem_t),
           mat1, &status);
       input_mat2 = clCreateBuffer(context,
-          CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, W * N * sizeof(cl_ulong),
+          CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, W * N * sizeof(mat_elem_t),
           mat2, &status);
+      input_mat2t = clCreateBuffer(context,
+          CL_MEM_READ_WRITE, W * N * sizeof(mat_elem_t), NULL, &status);
       output_result = clCreateBuffer(context,
-          CL_MEM_WRITE_ONLY, W * M * sizeof(cl_ulong), NULL, &status);
+          CL_MEM_WRITE_ONLY, M * N * sizeof(mat_elem_t), NULL, &status);
+
+      /* transpose second matrix once for matmult_transposed kernel */
+      for(int ki = 0 ; ki < nb_kernels ; ki++)
+      {
+        char kernel_name[1024];
+        size_t global_work_offset[2] = {0, 0};
+        size_t global_work_size[2] = {
+          (W + WORK_GROUP_SIZE - 1) / WORK_GROUP_SIZE * WORK_GROUP_SIZE,
+          (N + WORK_GROUP_SIZE - 1) / WORK_GROUP_SIZE * WORK_GROUP_SIZE};
+        size_t local_work_size[2] = {WORK_GROUP_SIZE, WORK_GROUP_SIZE};
+
+        clGetKernelInfo(kernels[ki], CL_KERNEL_FUNCTION_NAME,
+            sizeof(kernel_name), kernel_name, NULL);
+
+        if(strcmp(kernel_name, "transpose") != 0)
+        {
+          continue;
+        }
+
+        status = clSetKernelArg(kernels[ki], 0, sizeof(cl_mem), &input_mat2);
+        status |= clSetKernelArg(kernels[ki], 1, sizeof(cl_mem), &input_mat2t);
+        status |= clSetKernelArg(kernels[ki], 2, sizeof(cl_uint), &sizes[2]);
+        status |= clSetKernelArg(kernels[ki], 3, sizeof(cl_uint), &sizes[1]);
+
+        start = util_gettime_us();
+        if(status != CL_SUCCESS || (status = clEnqueueNDRangeKernel(queue,
+                kernels[ki], 2, global_work_offset, global_work_size,
+                local_work_size, 0, NULL, NULL)) != CL_SUCCESS)
+        {
+          fprintf(stderr, "Failed to transpose on %s: status=%d\n",
+              device_name, status);
+          break;
+        }
+
+        clFinish(queue);
+        end = util_gettime_us();
+        fprintf(stdout, "\ttranspose executed on %s in \t%f ms\n",
+            device_name, (end - start) / 1000);
+      }
 
       /* execute all the kernels */
       for(int ki = 0 ; ki < nb_kernels ; ki++)
       {
         char kernel_name[1024];
         size_t global_work_offset[2] = {0, 0};
-        size_t global_work_size[2] = {M, N};
-        size_t local_work_size[2] = {16, 16};
+        /* round up to whole work-groups, kernels skip work-items outside */
+        size_t global_work_size[2] = {
+          (M + WORK_GROUP_SIZE - 1) / WORK_GROUP_SIZE * WORK_GROUP_SIZE,
+          (N + WORK_GROUP_SIZE - 1) / WORK_GROUP_SIZE * WORK_GROUP_SIZE};
+        size_t local_work_size[2] = {WORK_GROUP_SIZE, WORK_GROUP_SIZE};
 
         clGetKernelInfo(kernels[ki], CL_KERNEL_FUNCTION_NAME,
             sizeof(kernel_name), kernel_name, NULL);
 
+        if(strcmp(kernel_name, "transpose") == 0)
+        {
+          continue;
+        }
+
+        if(strcmp(kernel_name, "matmult_tiled") == 0)
+        {
+          /* a work-item computes tile x tile elements */
+          size_t block = WORK_GROUP_SIZE * tile;
+
+          global_work_size[0] = (M + block - 1) / block * WORK_GROUP_SIZE;
+          global_work_size[1] = (N + block - 1) / block * WORK_GROUP_SIZE;
+        }
+
         status = clSetKernelArg(kernels[ki], 0, sizeof(cl_mem), &input_mat1);
-        status |= clSetKernelArg(kernels[ki], 1, sizeof(cl_mem), &input_mat2);
+        status |= clSetKernelArg(kernels[ki], 1, sizeof(cl_mem),
+            strcmp(kernel_name, "matmult_transposed") == 0 ?
+            &input_mat2t : &input_mat2);
         status |= clSetKernelArg(kernels[ki], 2, sizeof(cl_mem),
             &output_result);
-        status |= clSetKernelArg(kernels[ki], 3, sizeof(cl_uint), &M);
-        status |= clSetKernelArg(kernels[ki], 4, sizeof(cl_uint), &N);
-        status |= clSetKernelArg(kernels[ki], 5, sizeof(cl_uint), &W);
+        status |= clSetKernelArg(kernels[ki], 3, sizeof(cl_uint), &sizes[0]);
+        status |= clSetKernelArg(kernels[ki], 4, sizeof(cl_uint), &sizes[1]);
+        status |= clSetKernelArg(kernels[ki], 5, sizeof(cl_uint), &sizes[2]);
 
         if(status != CL_SUCCESS)
         {
@@ -294,7 +427,8 @@ int mat_mult_cl(cl_ulong* mat1, cl_ulong* mat2, cl_ulong* result, size_t M,
         }
 
         if((status = clEnqueueReadBuffer(queue, output_result, CL_FALSE, 0,
-                M * N * sizeof(cl_ulong), result, 0, NULL, NULL)) != CL_SUCCESS)
+                M * N * sizeof(mat_elem_t), result, 0, NULL, NULL)) !=
+            CL_SUCCESS)
         {
           fprintf(stderr,
               "clEnqueueReadBuffer failed for kernel %s on %s: status=%d\n",
@@ -311,6 +445,7 @@ int mat_mult_cl(cl_ulong* mat1, cl_ulong* mat2, cl_ulong* result, size_t M,
 
       clReleaseMemObject(input_mat1);
       clReleaseMemObject(input_mat2);
+      clReleaseMemObject(input_mat2t);
       clReleaseMemObject(output_result);
       clReleaseCommandQueue(queue);
     }
@@ -331,10 +466,17 @@ int mat_mult_cl(cl_ulong* mat1, cl_ulong* mat2, cl_ulong* result, size_t M,
  */
 void print_help(const char* program)
 {
-  fprintf(stdout, "Usage: %s [-m row size] [-p] [-h]\n\n"
+  fprintf(stdout, "Usage: %s [-m size] [-M rows] [-K common] [-N columns] "
+      "[-t tile] [-c dir] [-r] [-p] [-h]\n\n"
       "  -h\t\tDisplay this help\n"
+      "  -t tile\tTile side of matmult_tiled kernel: 2, 4 (default) or 8\n"
+      "  -c dir\tDirectory of cached program binaries (default .)\n"
+      "  -r\t\tBuild program from source without cache\n"
       "  -p\t\tPrint the input and output matrixes\n"
-      "  -m row\tRow/column size (default 1024)\n", program);
+      "  -m size\tSize of square matrixes (default 1024)\n"
+      "  -M rows\tRow size of first matrix (default -m)\n"
+      "  -K common\tColumn size of first matrix (default -m)\n"
+      "  -N columns\tColumn size of second matrix (default -m)\n", program);
 }
 
 /**
@@ -350,12 +492,21 @@ int parse_cmdline(int argc, char** argv,
   /*
    * h: print help and exit
    * p: print input and output matrixes
-   * m: row size
+   * m: square size
+   * M: row size of first matrix
+   * K: common dimension
+   * N: column size of second matrix
+   * c: directory of cached program binaries
+   * r: build program without cache
+   * t: tile side of matmult_tiled
    */
-  static const char* options = "hpm:";
+  static const char* options = "hpm:M:K:N:c:rt:";
   int opt = 0;
   int print_matrix = 0;
   long m = DEFAULT_ROW_SIZE;
+  long dims[3] = {0, 0, 0};
+  const char* cache_dir = DEFAULT_CACHE_DIR;
+  long tile = DEFAULT_TILE_SIZE;
   int ret = 1;
 
   assert(configuration);
@@ -380,6 +531,31 @@ int parse_cmdline(int argc, char** argv,
           ret = -1;
         }
         break;
+      case 'M':
+      case 'K':
+      case 'N':
+        dims[opt == 'M' ? 0 : opt == 'K' ? 1 : 2] = atol(optarg);
+        if(atol(optarg) < 1)
+        {
+          fprintf(stderr, "Bad argument for '-%c': %s\n", opt, optarg);
+          ret = -1;
+        }
+        break;
+      case 'c':
+        cache_dir = optarg;
+        break;
+      case 'r':
+        cache_dir = NULL;
+        break;
+      case 't':
+        /* tile rows are vectors */
+        tile = atol(optarg);
+        if(tile != 2 && tile != 4 && tile != 8)
+        {
+          fprintf(stderr, "Bad argument for '-t': %s\n", optarg);
+          ret = -1;
+        }
+        break;
       default:
         fprintf(stderr, "Bad option (%c)\n", optopt);
         ret = -1;
@@ -388,7 +564,11 @@ int parse_cmdline(int argc, char** argv,
   }
 
   configuration->print_matrix = print_matrix;
-  configuration->m = m;
+  configuration->cache_dir = cache_dir;
+  configuration->tile = tile;
+  configuration->m = dims[0] ? (size_t)dims[0] : (size_t)m;
+  configuration->w = dims[1] ? (size_t)dims[1] : (size_t)m;
+  configuration->n = dims[2] ? (size_t)dims[2] : (size_t)m;
 
   return ret;
 }
@@ -401,9 +581,9 @@ int parse_cmdline(int argc, char** argv,
  */
 int main(int argc, char** argv)
 {
-  cl_ulong* mat1 = NULL;
-  cl_ulong* mat2 = NULL;
-  cl_ulong* mat3 = NULL;
+  mat_elem_t* mat1 = NULL;
+  mat_elem_t* mat2 = NULL;
+  mat_elem_t* mat3 = NULL;
   size_t m = DEFAULT_ROW_SIZE;
   size_t n = DEFAULT_COLUMN_SIZE;
   size_t w = DEFAULT_COLUMN_SIZE;
@@ -424,15 +604,15 @@ int main(int argc, char** argv)
   }
 
   m = config.m;
-  n = config.m;
-  w = config.m;
+  n = config.n;
+  w = config.w;
   print_matrix = config.print_matrix;
 
   nb_elements = m * n;
 
-  mat1 = malloc(nb_elements * sizeof(cl_ulong));
-  mat2 = malloc(nb_elements * sizeof(cl_ulong));
-  mat3 = malloc(nb_elements * sizeof(cl_ulong));
+  mat1 = mat_alloc(m * w);
+  mat2 = mat_alloc(w * n);
+  mat3 = mat_alloc(nb_elements);
 
   if(!mat1 || !mat2 || !mat3)
   {
@@ -443,17 +623,18 @@ int main(int argc, char** argv)
     exit(EXIT_FAILURE);
   }
 
-  mat_init(mat1, mat2, m, n);
+  mat_init(mat1, mat2, m, n, w);
 
   if(print_matrix)
   {
     printf("Matrix 1:\n");
-    mat_print(mat1, m, n);
+    mat_print(mat1, m, w);
     printf("Matrix 2:\n");
-    mat_print(mat2, m, n);
+    mat_print(mat2, w, n);
   }
 
-  if(mat_mult_cl(mat1, mat2, mat3, m, n, w) == -1)
+  if(mat_mult_cl(mat1, mat2, mat3, m, n, w, config.tile, config.cache_dir)
+      == -1)
   {
     fprintf(stderr, "Matrixes cannot be multiplied\n");
     ret = EXIT_FAILURE;
@@ -12,74 +12,136 @@
  * \date 2014-2016
  */
 
+#ifndef MAT_ELEM
+/**
+ * \def MAT_ELEM
+ * \brief Element type of matrixes (set by host with -DMAT_ELEM=type).
+ */
+#define MAT_ELEM ulong
+#endif
+
+#ifdef MAT_ELEM_FP64
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#endif
+
 /**
  * \def BLOCK_SIZE
  * \brief Size of a matrix block.
  */
 #define BLOCK_SIZE 16
 
+#ifndef TILE_M
+/**
+ * \def TILE_M
+ * \brief Rows of the tile of result computed by a work-item of matmult_tiled
+ * (set by host with -DTILE_M=rows).
+ */
+#define TILE_M 4
+#endif
+
+#ifndef TILE_N
+/**
+ * \def TILE_N
+ * \brief Columns of the tile of result computed by a work-item of
+ * matmult_tiled, a vector width: 2, 4, 8 or 16 (set by host with
+ * -DTILE_N=columns).
+ */
+#define TILE_N 4
+#endif
+
+/**
+ * \def CONCAT
+ * \brief Pastes two tokens after expanding them.
+ */
+#define CONCAT_(a, b) a ## b
+#define CONCAT(a, b) CONCAT_(a, b)
+
+/**
+ * \def MAT_VEC
+ * \brief Vector of TILE_N elements (i.e. ulong4).
+ */
+#define MAT_VEC CONCAT(MAT_ELEM, TILE_N)
+
+/**
+ * \def MAT_VLOAD
+ * \brief Loads a vector of TILE_N elements (i.e. vload4).
+ */
+#define MAT_VLOAD CONCAT(vload, TILE_N)
+
+/**
+ * \def MAT_VSTORE
+ * \brief Stores a vector of TILE_N elements (i.e. vstore4).
+ */
+#define MAT_VSTORE CONCAT(vstore, TILE_N)
+
 /**
  * \brief Multiply two matrixes and store result in third ones.
- * \param mat1 first matrix.
- * \param mat2 second matrix.
- * \param result result matrix.
+ *
+ * Global work size may be rounded up to a multiple of the work-group size,
+ * work-items outside result do nothing.
+ * \param mat1 first matrix (M x W).
+ * \param mat2 second matrix (W x N).
+ * \param result result matrix (M x N).
  * \param M row size of first matrix.
- * \param N column size of first matrix.
- * \param W row size of second matrix.
+ * \param N column size of second matrix.
+ * \param W column size of first matrix.
  */
-__kernel void matmult(__global ulong* mat1, __global ulong* mat2,
-    __global ulong* result, uint M, uint N, uint W)
+__kernel void matmult(__global MAT_ELEM* mat1, __global MAT_ELEM* mat2,
+    __global MAT_ELEM* result, uint M, uint N, uint W)
 {
   int i = get_global_id(0);
   int j = get_global_id(1);
-  ulong tmp = 0;
+  MAT_ELEM tmp = 0;
+
+  if(i >= M || j >= N)
+  {
+    return;
+  }
 
   for(size_t k = 0 ; k < W ; k++)
   {
     tmp += mat1[i * W + k] * mat2[k * N + j];
   }
 
-  result[i * M + j] = tmp;
+  result[i * N + j] = tmp;
 }
 
 /**
  * \brief Optimized multiplication of two matrixes.
- * \param mat1 first matrix.
- * \param mat2 second matrix.
- * \param result result matrix.
+ *
+ * Blocks of both matrixes are copied in local memory, elements outside the
+ * matrixes are replaced by zeros so that any shape can be computed.
+ * \param mat1 first matrix (M x W).
+ * \param mat2 second matrix (W x N).
+ * \param result result matrix (M x N).
  * \param M row size of first matrix.
- * \param N column size of first matrix.
- * \param W row size of second matrix.
+ * \param N column size of second matrix.
+ * \param W column size of first matrix.
  */
-__kernel void matmult2(__global ulong* mat1, __global ulong* mat2,
-    __global ulong* result, uint M, uint N, uint W)
+__kernel void matmult2(__global MAT_ELEM* mat1, __global MAT_ELEM* mat2,
+    __global MAT_ELEM* result, uint M, uint N, uint W)
 {
     int i = get_global_id(0);
     int j = get_global_id(1);
-    int groupi = get_group_id(0);
-    int groupj = get_group_id(1);
     int loci = get_local_id(0);
     int locj = get_local_id(1);
-    /* row group starts at row block (row size x block size) x row number
-     * column group starts at block size x column number
-     */
-    size_t mat1_offset = M * BLOCK_SIZE * groupi;
-    size_t mat1_offset_end = mat1_offset + M;
-    size_t mat2_offset = BLOCK_SIZE * groupj;
-    size_t mat1_step = BLOCK_SIZE;
-    size_t mat2_step = BLOCK_SIZE * W;
-    ulong tmp = 0;
-    __local ulong local_row[BLOCK_SIZE * BLOCK_SIZE];
-    __local ulong local_col[BLOCK_SIZE * BLOCK_SIZE];
-
-    for(size_t off1 = mat1_offset, off2 = mat2_offset ; off1 < mat1_offset_end ;
-        off1 += mat1_step, off2 += mat2_step)
+    MAT_ELEM tmp = 0;
+    __local MAT_ELEM local_row[BLOCK_SIZE * BLOCK_SIZE];
+    __local MAT_ELEM local_col[BLOCK_SIZE * BLOCK_SIZE];
+
+    for(size_t off = 0 ; off < W ; off += BLOCK_SIZE)
     {
-        size_t idx = loci * BLOCK_SIZE + locj;
+        /* column of first matrix and row of second matrix to copy */
+        size_t k1 = off + locj;
+        size_t k2 = off + loci;
 
-        /* copy block of matrix from global memory to local */
-        local_row[idx] = mat1[off1 + loci * M + locj];
-        local_col[idx] = mat2[off2 + locj * W + loci];
+        /* copy block of matrix from global memory to local, second matrix
+         * block is stored transposed
+         */
+        local_row[loci * BLOCK_SIZE + locj] =
+          (i < M && k1 < W) ? mat1[i * W + k1] : 0;
+        local_col[locj * BLOCK_SIZE + loci] =
+          (j < N && k2 < W) ? mat2[k2 * N + j] : 0;
 
         /* wait until all data are copied to local memory */
         barrier(CLK_LOCAL_MEM_FENCE);
@@ -95,44 +157,42 @@ __kernel void matmult2(__global ulong* mat1, __global ulong* mat2,
         barrier(CLK_LOCAL_MEM_FENCE);
     }
 
-    result[i * M + j] = tmp;
+    if(i < M && j < N)
+    {
+        result[i * N + j] = tmp;
+    }
 }
 
 /**
  * \brief Optimized multiplication of two matrixes.
- * \param mat1 first matrix.
- * \param mat2 second matrix.
- * \param result result matrix.
+ *
+ * Same as matmult2 with two-dimensional local blocks.
+ * \param mat1 first matrix (M x W).
+ * \param mat2 second matrix (W x N).
+ * \param result result matrix (M x N).
  * \param M row size of first matrix.
- * \param N column size of first matrix.
- * \param W row size of second matrix.
+ * \param N column size of second matrix.
+ * \param W column size of first matrix.
  */
-__kernel void matmult3(__global ulong* mat1, __global ulong* mat2,
-    __global ulong* result, uint M, uint N, uint W)
+__kernel void matmult3(__global MAT_ELEM* mat1, __global MAT_ELEM* mat2,
+    __global MAT_ELEM* result, uint M, uint N, uint W)
 {
-    int groupi = get_group_id(0);
-    int groupj = get_group_id(1);
+    int i = get_global_id(0);
+    int j = get_global_id(1);
     int loci = get_local_id(0);
     int locj = get_local_id(1);
-    /*
-     * row matrix starts at row block (row size x block size) x row number
-     * column matrix starts at block size x column number
-     */
-    size_t mat1_offset = M * BLOCK_SIZE * groupi;
-    size_t mat1_offset_end = mat1_offset + M;
-    size_t mat2_offset = BLOCK_SIZE * groupj;
-    size_t mat1_step = BLOCK_SIZE;
-    size_t mat2_step = BLOCK_SIZE * W;
-    ulong tmp = 0;
-    __local ulong local_row[BLOCK_SIZE][BLOCK_SIZE];
-    __local ulong local_col[BLOCK_SIZE][BLOCK_SIZE];
-
-    for(size_t off1 = mat1_offset, off2 = mat2_offset ; off1 < mat1_offset_end ;
-        off1 += mat1_step, off2 += mat2_step)
+    MAT_ELEM tmp = 0;
+    __local MAT_ELEM local_row[BLOCK_SIZE][BLOCK_SIZE];
+    __local MAT_ELEM local_col[BLOCK_SIZE][BLOCK_SIZE];
+
+    for(size_t off = 0 ; off < W ; off += BLOCK_SIZE)
     {
+        size_t k1 = off + locj;
+        size_t k2 = off + loci;
+
         /* copy block of matrix from global memory to local */
-        local_row[locj][loci] = mat1[off1 + locj * M + loci];
-        local_col[locj][loci] = mat2[off2 + locj * W + loci];
+        local_row[loci][locj] = (i < M && k1 < W) ? mat1[i * W + k1] : 0;
+        local_col[loci][locj] = (j < N && k2 < W) ? mat2[k2 * N + j] : 0;
 
         /* wait until all data are copied to local memory */
         barrier(CLK_LOCAL_MEM_FENCE);
@@ -147,6 +207,183 @@ __kernel void matmult3(__global ulong* mat1, __global ulong* mat2,
         barrier(CLK_LOCAL_MEM_FENCE);
     }
 
-    result[get_global_id(0) * M + get_global_id(1)] = tmp;
+    if(i < M && j < N)
+    {
+        result[i * N + j] = tmp;
+    }
+}
+
+/**
+ * \brief Transposes a matrix.
+ *
+ * A block is copied in local memory so that both reads and writes of global
+ * memory are coalesced, padding column avoids bank conflicts.
+ * \param src source matrix (rows x cols).
+ * \param dst destination matrix (cols x rows).
+ * \param rows row size of source.
+ * \param cols column size of source.
+ */
+__kernel void transpose(__global MAT_ELEM* src, __global MAT_ELEM* dst,
+    uint rows, uint cols)
+{
+    int i = get_global_id(0);
+    int j = get_global_id(1);
+    int loci = get_local_id(0);
+    int locj = get_local_id(1);
+    __local MAT_ELEM tile[BLOCK_SIZE][BLOCK_SIZE + 1];
+    /* the block goes to the symmetric position in destination */
+    int ti = get_group_id(1) * BLOCK_SIZE + loci;
+    int tj = get_group_id(0) * BLOCK_SIZE + locj;
+
+    if(i < rows && j < cols)
+    {
+        tile[loci][locj] = src[i * cols + j];
+    }
+
+    /* wait until the block is copied to local memory */
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    if(ti < cols && tj < rows)
+    {
+        dst[ti * rows + tj] = tile[locj][loci];
+    }
+}
+
+/**
+ * \brief Multiplication of a matrix by a transposed one.
+ *
+ * Both matrixes are read along rows.
+ * \param mat1 first matrix (M x W).
+ * \param mat2t transposed second matrix (N x W).
+ * \param result result matrix (M x N).
+ * \param M row size of first matrix.
+ * \param N column size of second matrix.
+ * \param W column size of first matrix.
+ */
+__kernel void matmult_transposed(__global MAT_ELEM* mat1,
+    __global MAT_ELEM* mat2t, __global MAT_ELEM* result, uint M, uint N,
+    uint W)
+{
+  int i = get_global_id(0);
+  int j = get_global_id(1);
+  MAT_ELEM tmp = 0;
+
+  if(i >= M || j >= N)
+  {
+    return;
+  }
+
+  for(size_t k = 0 ; k < W ; k++)
+  {
+    tmp += mat1[i * W + k] * mat2t[j * W + k];
+  }
+
+  result[i * N + j] = tmp;
 }
 
+/**
+ * \brief Register-blocked multiplication of two matrixes.
+ *
+ * A work-group of BLOCK_SIZE x BLOCK_SIZE work-items computes a block of
+ * (BLOCK_SIZE * TILE_M) x (BLOCK_SIZE * TILE_N) elements of result, each
+ * work-item accumulates a tile of TILE_M x TILE_N elements in registers
+ * (TILE_M vectors). Blocks of both matrixes are copied in local memory by
+ * slices of BLOCK_SIZE along the common dimension, then each element of
+ * first matrix read from local memory is multiplied by a vector of second
+ * matrix, so that there are TILE_M + 1 local loads for TILE_M * TILE_N
+ * products instead of two loads per product. Global work size is
+ * BLOCK_SIZE work-items per block in each dimension, elements outside the
+ * matrixes are replaced by zeros.
+ * \param mat1 first matrix (M x W).
+ * \param mat2 second matrix (W x N).
+ * \param result result matrix (M x N).
+ * \param M row size of first matrix.
+ * \param N column size of second matrix.
+ * \param W column size of first matrix.
+ */
+__kernel void matmult_tiled(__global MAT_ELEM* mat1, __global MAT_ELEM* mat2,
+    __global MAT_ELEM* result, uint M, uint N, uint W)
+{
+    int loci = get_local_id(0);
+    int locj = get_local_id(1);
+    /* first row and column of the block of work-group */
+    size_t bi = get_group_id(0) * BLOCK_SIZE * TILE_M;
+    size_t bj = get_group_id(1) * BLOCK_SIZE * TILE_N;
+    MAT_VEC acc[TILE_M];
+    __local MAT_ELEM local_row[BLOCK_SIZE * TILE_M][BLOCK_SIZE];
+    __local MAT_ELEM local_col[BLOCK_SIZE][BLOCK_SIZE * TILE_N];
+
+    for(int r = 0 ; r < TILE_M ; r++)
+    {
+        acc[r] = 0;
+    }
+
+    for(size_t off = 0 ; off < W ; off += BLOCK_SIZE)
+    {
+        size_t k1 = off + locj;
+        size_t k2 = off + loci;
+
+        /* each work-item copies TILE_M elements of first matrix and TILE_N
+         * of second one, consecutive work-items read consecutive elements
+         */
+        for(int r = 0 ; r < TILE_M ; r++)
+        {
+            size_t i = bi + r * BLOCK_SIZE + loci;
+
+            local_row[r * BLOCK_SIZE + loci][locj] =
+              (i < M && k1 < W) ? mat1[i * W + k1] : 0;
+        }
+
+        for(int c = 0 ; c < TILE_N ; c++)
+        {
+            size_t j = bj + c * BLOCK_SIZE + locj;
+
+            local_col[loci][c * BLOCK_SIZE + locj] =
+              (j < N && k2 < W) ? mat2[k2 * N + j] : 0;
+        }
+
+        /* wait until all data are copied to local memory */
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        for(int k = 0 ; k < BLOCK_SIZE ; k++)
+        {
+            MAT_VEC b = MAT_VLOAD(0, &local_col[k][locj * TILE_N]);
+
+            for(int r = 0 ; r < TILE_M ; r++)
+            {
+                acc[r] += local_row[loci * TILE_M + r][k] * b;
+            }
+        }
+
+        /* wait until the blocks have been used to copy next ones */
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    for(int r = 0 ; r < TILE_M ; r++)
+    {
+        size_t i = bi + loci * TILE_M + r;
+        size_t j = bj + locj * TILE_N;
+
+        if(i >= M || j >= N)
+        {
+            continue;
+        }
+
+        if(j + TILE_N <= N)
+        {
+            MAT_VSTORE(acc[r], 0, &result[i * N + j]);
+        }
+        else
+        {
+            /* tile crosses last column */
+            MAT_ELEM tile[TILE_N];
+
+            MAT_VSTORE(acc[r], 0, tile);
+
+            for(size_t c = 0 ; c < N - j ; c++)
+            {
+                result[i * N + j + c] = tile[c];
+            }
+        }
+    }
+}
@@ -23,10 +23,179 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
 #include <errno.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
 
 #include "util_opencl.h"
 
+/**
+ * \brief Maximum size of the path of a cached binary.
+ */
+#define OPENCL_CACHE_PATH_SIZE 1024
+
+/**
+ * \brief Hashes data with 64-bit FNV-1a.
+ * \param hash hash of previous data (0xcbf29ce484222325 to start).
+ * \param data data.
+ * \param size size of data.
+ * \return hash.
+ */
+static uint64_t opencl_hash(uint64_t hash, const void* data, size_t size)
+{
+  const unsigned char* bytes = data;
+
+  for(size_t i = 0 ; i < size ; i++)
+  {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ULL;
+  }
+
+  return hash;
+}
+
+/**
+ * \brief Gets the path of the cached binary of a program for a device.
+ * \param device OpenCL device.
+ * \param source_hash hash of program source.
+ * \param options build options.
+ * \param cache_dir directory of cached binaries.
+ * \param path buffer of OPENCL_CACHE_PATH_SIZE bytes that will handle path.
+ * \param status OpenCL last error code (useful if return code equals -1).
+ * \return 0 if success, -1 otherwise.
+ */
+static int opencl_cache_path(cl_device_id device, uint64_t source_hash,
+    const char* options, const char* cache_dir, char* path, cl_int* status)
+{
+  char name[1024];
+  char driver[1024];
+  uint64_t hash = source_hash;
+
+  if((*status = clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(name), name,
+          NULL)) != CL_SUCCESS ||
+      (*status = clGetDeviceInfo(device, CL_DRIVER_VERSION, sizeof(driver),
+          driver, NULL)) != CL_SUCCESS)
+  {
+    return -1;
+  }
+
+  /* terminating null characters separate fields */
+  hash = opencl_hash(hash, options, strlen(options) + 1);
+  hash = opencl_hash(hash, name, strlen(name) + 1);
+  hash = opencl_hash(hash, driver, strlen(driver) + 1);
+
+  return snprintf(path, OPENCL_CACHE_PATH_SIZE, "%s/%016" PRIx64 ".clbin",
+      cache_dir, hash) < OPENCL_CACHE_PATH_SIZE ? 0 : -1;
+}
+
+/**
+ * \brief Creates a program from the cached binaries of all devices.
+ * \param context OpenCL context to use.
+ * \param nb_devices number of devices.
+ * \param devices devices.
+ * \param paths paths of cached binaries, one per device.
+ * \return program, or NULL if a binary is missing or cannot be loaded.
+ */
+static cl_program opencl_load_binaries(cl_context context, cl_uint nb_devices,
+    const cl_device_id* devices, const char* paths)
+{
+  unsigned char** binaries = calloc(nb_devices, sizeof(unsigned char*));
+  size_t* sizes = calloc(nb_devices, sizeof(size_t));
+  cl_program program = NULL;
+  cl_int status = CL_SUCCESS;
+  int found = binaries && sizes;
+
+  for(cl_uint i = 0 ; found && i < nb_devices ; i++)
+  {
+    found = opencl_get_file_data(&paths[i * OPENCL_CACHE_PATH_SIZE],
+        (char**)&binaries[i], &sizes[i]) == 0;
+  }
+
+  if(found)
+  {
+    program = clCreateProgramWithBinary(context, nb_devices, devices, sizes,
+        (const unsigned char**)binaries, NULL, &status);
+
+    if(status != CL_SUCCESS)
+    {
+      program = NULL;
+    }
+  }
+
+  for(cl_uint i = 0 ; binaries && i < nb_devices ; i++)
+  {
+    free(binaries[i]);
+  }
+  free(binaries);
+  free(sizes);
+  return program;
+}
+
+/**
+ * \brief Writes binaries of a built program to the cache. Cache is only an
+ * optimization, failures are ignored.
+ * \param program built OpenCL program.
+ * \param nb_devices number of devices of the program.
+ * \param paths paths of cached binaries, one per device.
+ */
+static void opencl_save_binaries(cl_program program, cl_uint nb_devices,
+    const char* paths)
+{
+  unsigned char** binaries = calloc(nb_devices, sizeof(unsigned char*));
+  size_t* sizes = calloc(nb_devices, sizeof(size_t));
+  int ok = binaries && sizes &&
+    clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES,
+        nb_devices * sizeof(size_t), sizes, NULL) == CL_SUCCESS;
+
+  for(cl_uint i = 0 ; ok && i < nb_devices ; i++)
+  {
+    ok = (binaries[i] = malloc(sizes[i] + 1)) != NULL;
+  }
+
+  if(ok && clGetProgramInfo(program, CL_PROGRAM_BINARIES,
+        nb_devices * sizeof(unsigned char*), binaries, NULL) == CL_SUCCESS)
+  {
+    for(cl_uint i = 0 ; i < nb_devices ; i++)
+    {
+      const char* path = &paths[i * OPENCL_CACHE_PATH_SIZE];
+      char tmp[OPENCL_CACHE_PATH_SIZE + 32];
+      FILE* file = NULL;
+
+      /* written apart then renamed so that concurrent runs never read a
+       * partial binary
+       */
+      snprintf(tmp, sizeof(tmp), "%s.%ld", path, (long)getpid());
+      file = fopen(tmp, "wb");
+
+      if(!file)
+      {
+        continue;
+      }
+
+      if(fwrite(binaries[i], 1, sizes[i], file) == sizes[i] &&
+          fclose(file) == 0)
+      {
+        rename(tmp, path);
+      }
+      else
+      {
+        remove(tmp);
+      }
+    }
+  }
+
+  for(cl_uint i = 0 ; binaries && i < nb_devices ; i++)
+  {
+    free(binaries[i]);
+  }
+  free(binaries);
+  free(sizes);
+}
+
 int opencl_get_platforms(cl_platform_id** platforms, cl_int* status)
 {
   cl_uint nb = 0;
@@ -121,6 +290,87 @@ int opencl_get_program_from_file(cl_context context, const char* file_path,
   return ret;
 }
 
+int opencl_build_program_cached(cl_context context, cl_uint nb_devices,
+    const cl_device_id* devices, const char* file_path, const char* options,
+    const char* cache_dir, cl_program* program, int* cached, cl_int* status)
+{
+  int ret = 0;
+  size_t data_size = 0;
+  char* data = NULL;
+  char* paths = NULL;
+
+  *status = CL_SUCCESS;
+  *program = NULL;
+  *cached = 0;
+
+  ret = opencl_get_file_data(file_path, &data, &data_size);
+
+  if(ret < 0)
+  {
+    return ret;
+  }
+
+  if(cache_dir)
+  {
+    uint64_t hash = opencl_hash(0xcbf29ce484222325ULL, data, data_size);
+
+    paths = malloc(nb_devices * OPENCL_CACHE_PATH_SIZE);
+
+    for(cl_uint i = 0 ; paths && i < nb_devices ; i++)
+    {
+      if(opencl_cache_path(devices[i], hash, options, cache_dir,
+            &paths[i * OPENCL_CACHE_PATH_SIZE], status) != 0)
+      {
+        free(paths);
+        paths = NULL;
+      }
+    }
+  }
+
+  if(paths)
+  {
+    *program = opencl_load_binaries(context, nb_devices, devices, paths);
+
+    /* binaries still have to be built, stale ones are rebuilt from source */
+    if(*program && clBuildProgram(*program, nb_devices, devices, options,
+          NULL, NULL) == CL_SUCCESS)
+    {
+      *cached = 1;
+    }
+    else if(*program)
+    {
+      clReleaseProgram(*program);
+      *program = NULL;
+    }
+  }
+
+  if(!*cached)
+  {
+    *program = clCreateProgramWithSource(context, 1, (const char**)&data,
+        &data_size, status);
+
+    if(*status != CL_SUCCESS)
+    {
+      *program = NULL;
+      ret = -1;
+    }
+    else if((*status = clBuildProgram(*program, nb_devices, devices, options,
+            NULL, NULL)) != CL_SUCCESS)
+    {
+      ret = -1;
+    }
+    else if(paths)
+    {
+      mkdir(cache_dir, 0755);
+      opencl_save_binaries(*program, nb_devices, paths);
+    }
+  }
+
+  free(paths);
+  free(data);
+  return ret;
+}
+
 int opencl_get_file_data(const char* file_path, char** program,
   size_t* program_size)
 {
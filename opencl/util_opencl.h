@@ -58,6 +58,29 @@ int opencl_get_devices(cl_platform_id platform, cl_device_id** devices,
 int opencl_get_program_from_file(cl_context context, const char* file_path,
     cl_program* program, cl_int* status);
 
+/**
+ * \brief Retrieves OpenCL program from a file and builds it. Binaries of the
+ * program are cached in a directory, one file per device named after a hash
+ * of device name, driver version, build options and source, so that next
+ * runs load them instead of building the source.
+ * \param context OpenCL context to use.
+ * \param nb_devices number of devices.
+ * \param devices all devices of the context.
+ * \param file_path path of the OpenCL file.
+ * \param options build options.
+ * \param cache_dir directory of cached binaries (NULL not to cache them).
+ * \param program pointer that will handle built OpenCL program.
+ * \param cached set to 1 if program was loaded from cache, 0 otherwise.
+ * \param status OpenCL last error code (useful if return code equals -1).
+ * \return 0 if success, -1 if OpenCL error, negative integer (errno)
+ * otherwise.
+ * \note If build fails, *program is set so that build log can be retrieved,
+ * caller MUST release it.
+ */
+int opencl_build_program_cached(cl_context context, cl_uint nb_devices,
+    const cl_device_id* devices, const char* file_path, const char* options,
+    const char* cache_dir, cl_program* program, int* cached, cl_int* status);
+
 /**
  * \brief Retrieves OpenCL file content.
  * \param file_path path of the OpenCL file.
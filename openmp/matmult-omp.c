@@ -24,6 +24,10 @@
 
 #include <omp.h>
 
+#include "mat_type.h"
+#include "mat_kernel.h"
+#include "mat_transpose.h"
+
 /**
  * \brief Default row size.
  */
@@ -34,6 +38,33 @@ static const size_t DEFAULT_ROW_SIZE = 1024;
  */
 static const size_t DEFAULT_COLUMN_SIZE = 1024;
 
+/**
+ * \brief Side of result tiles shared out to threads by naive algorithm.
+ */
+#define TILE_SIZE 64
+
+/**
+ * \brief Number of barriers timed per thread count by the barrier benchmark.
+ */
+#define BARRIER_RUNS 10000
+
+/**
+ * \brief Default size below which task algorithm stops spawning tasks.
+ */
+static const size_t DEFAULT_TASK_CUTOFF = 64;
+
+/**
+ * \enum mat_algorithm
+ * \brief Multiplication algorithm.
+ */
+enum mat_algorithm
+{
+  MAT_NAIVE = 0, /**< Textbook i-j-k loop (reference). */
+  MAT_PACKED, /**< Packed panels with register-blocked micro-kernel. */
+  MAT_TASK, /**< Recursive splitting with OpenMP tasks. */
+  MAT_TRANSPOSED /**< Dot products with transposed second matrix. */
+};
+
 /**
  * \struct configuration
  * \brief Configuration.
@@ -41,10 +72,20 @@ static const size_t DEFAULT_COLUMN_SIZE = 1024;
 struct configuration
 {
   /**
-   * \brief Row/column size.
+   * \brief Row size of first matrix.
    */
   size_t m;
 
+  /**
+   * \brief Column size of second matrix.
+   */
+  size_t n;
+
+  /**
+   * \brief Common dimension (column size of first matrix).
+   */
+  size_t w;
+
   /**
    * \brief Print input and output matrixes.
    */
@@ -54,6 +95,31 @@ struct configuration
    * \brief Number of threads.
    */
   size_t threads;
+
+  /**
+   * \brief Multiplication algorithm.
+   */
+  enum mat_algorithm algorithm;
+
+  /**
+   * \brief Schedule kind of naive algorithm.
+   */
+  omp_sched_t schedule;
+
+  /**
+   * \brief Chunk size of schedule (0 for default).
+   */
+  int chunk;
+
+  /**
+   * \brief Run barrier benchmark instead of multiplication.
+   */
+  int barrier_bench;
+
+  /**
+   * \brief Size below which task algorithm stops spawning tasks.
+   */
+  size_t cutoff;
 };
 
 /**
@@ -71,15 +137,21 @@ static double util_gettime_us(void)
  * \brief Initializes the matrixes.
  * \param mat1 first matrix.
  * \param mat2 second matrix.
- * \param m row size of the matrix.
- * \param n column size of the matrix.
+ * \param m row size of first matrix.
+ * \param n column size of second matrix.
+ * \param w column size of first matrix.
  */
-void mat_init(uint64_t* mat1, uint64_t* mat2, size_t m, size_t n)
+void mat_init(mat_elem_t* mat1, mat_elem_t* mat2, size_t m, size_t n,
+    size_t w)
 {
-  for(size_t i = 0 ; i < (m * n) ; i++)
+  for(size_t i = 0 ; i < (m * w) ; i++)
+  {
+    mat1[i] = MAT_ELEM_INIT(i);
+  }
+
+  for(size_t i = 0 ; i < (w * n) ; i++)
   {
-    mat1[i] = i;
-    mat2[i] = i;
+    mat2[i] = MAT_ELEM_INIT(i);
   }
 }
 
@@ -89,13 +161,13 @@ void mat_init(uint64_t* mat1, uint64_t* mat2, size_t m, size_t n)
  * \param m row size of the matrix.
  * \param n column size of the matrix.
  */
-void mat_print(uint64_t* mat, size_t m, size_t n)
+void mat_print(mat_elem_t* mat, size_t m, size_t n)
 {
   for(size_t i = 0 ; i < m ; i++)
   {
     for(size_t j = 0 ; j < n ; j++)
     {
-      fprintf(stdout, "%lu ", mat[i * m + j]);
+      fprintf(stdout, MAT_ELEM_FMT " ", mat[i * n + j]);
     }
     fprintf(stdout, "\n");
   }
@@ -103,56 +175,324 @@ void mat_print(uint64_t* mat, size_t m, size_t n)
 
 /**
  * \brief Performs multiplication of matrixes.
+ *
+ * Tiles of result are shared out by a single collapsed loop, so that the
+ * whole multiplication costs one barrier. Schedule is the runtime one (see
+ * omp_set_schedule() and OMP_SCHEDULE).
  * \param mat1 first matrix.
  * \param mat2 second matrix.
  * \param result result matrix.
  * \param m row size of first matrix.
- * \param n column size of first matrix.
+ * \param n column size of second matrix.
+ * \param w column size of first matrix.
+ * \param threads thread number.
+ * \return 0.
+ */
+int mat_mult_omp(const mat_elem_t* restrict mat1,
+    const mat_elem_t* restrict mat2, mat_elem_t* restrict result, size_t m,
+    size_t n, size_t w, size_t threads)
+{
+  size_t tiles_m = (m + TILE_SIZE - 1) / TILE_SIZE;
+  size_t tiles_n = (n + TILE_SIZE - 1) / TILE_SIZE;
+
+  /* to set spread way, add to next line: proc_bind(spread) */
+  #pragma omp parallel for num_threads(threads) collapse(2) schedule(runtime)
+  for(size_t ti = 0 ; ti < tiles_m ; ti++)
+  {
+    for(size_t tj = 0 ; tj < tiles_n ; tj++)
+    {
+      size_t last_row = (ti + 1) * TILE_SIZE < m ? (ti + 1) * TILE_SIZE : m;
+      size_t first_col = tj * TILE_SIZE;
+      size_t cols = (tj + 1) * TILE_SIZE < n ? TILE_SIZE : n - first_col;
+
+      /* i-k-j order: rows of second matrix and result are read with unit
+       * stride in the vectorized loop, each element still sums its products
+       * in k order
+       */
+      for(size_t i = ti * TILE_SIZE ; i < last_row ; i++)
+      {
+        mat_elem_t* restrict res = &result[i * n + first_col];
+
+        #pragma omp simd
+        for(size_t j = 0 ; j < cols ; j++)
+        {
+          res[j] = 0;
+        }
+
+        for(size_t k = 0 ; k < w ; k++)
+        {
+          mat_elem_t av = mat1[i * w + k];
+          const mat_elem_t* restrict bk = &mat2[k * n + first_col];
+
+          #pragma omp simd
+          for(size_t j = 0 ; j < cols ; j++)
+          {
+            res[j] += av * bk[j];
+          }
+        }
+      }
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * \brief Transposes second matrix, blocks of rows are shared out to threads.
+ * \param mat2 second matrix (w x n).
+ * \param mat2t transposed second matrix (n x w).
+ * \param n column size of second matrix.
  * \param w row size of second matrix.
+ * \param arg thread number (size_t).
+ */
+void mat_transpose_omp(const mat_elem_t* restrict mat2,
+    mat_elem_t* restrict mat2t, size_t n, size_t w, void* arg)
+{
+  size_t threads = *(size_t*)arg;
+  size_t blocks = (w + MAT_TRANSPOSE_BLOCK - 1) / MAT_TRANSPOSE_BLOCK;
+
+  #pragma omp parallel for num_threads(threads) schedule(static)
+  for(size_t bi = 0 ; bi < blocks ; bi++)
+  {
+    size_t first_row = bi * MAT_TRANSPOSE_BLOCK;
+    size_t last_row = first_row + MAT_TRANSPOSE_BLOCK < w ?
+      first_row + MAT_TRANSPOSE_BLOCK : w;
+
+    mat_transpose(mat2, mat2t, w, n, first_row, last_row);
+  }
+}
+
+/**
+ * \brief Performs multiplication of matrixes with transposed second matrix,
+ * each element of result is a dot product of two contiguous rows. Tiles are
+ * shared out as in mat_mult_omp().
+ * \param mat1 first matrix.
+ * \param mat2t transposed second matrix (n x w).
+ * \param result result matrix.
+ * \param m row size of first matrix.
+ * \param n column size of second matrix.
+ * \param w column size of first matrix.
  * \param threads thread number.
- * \return 0 if success, -1 if matrixes cannot be multiplied.
+ * \return 0.
  */
-int mat_mult_omp(uint64_t* mat1, uint64_t* mat2, uint64_t* result, size_t m,
+int mat_mult_omp_transposed(const mat_elem_t* restrict mat1,
+    const mat_elem_t* restrict mat2t, mat_elem_t* restrict result, size_t m,
     size_t n, size_t w, size_t threads)
 {
-  if(n != w)
+  size_t tiles_m = (m + TILE_SIZE - 1) / TILE_SIZE;
+  size_t tiles_n = (n + TILE_SIZE - 1) / TILE_SIZE;
+
+  #pragma omp parallel for num_threads(threads) collapse(2) schedule(runtime)
+  for(size_t ti = 0 ; ti < tiles_m ; ti++)
   {
-    return -1;
+    for(size_t tj = 0 ; tj < tiles_n ; tj++)
+    {
+      size_t last_row = (ti + 1) * TILE_SIZE < m ? (ti + 1) * TILE_SIZE : m;
+      size_t last_col = (tj + 1) * TILE_SIZE < n ? (tj + 1) * TILE_SIZE : n;
+
+      for(size_t i = ti * TILE_SIZE ; i < last_row ; i++)
+      {
+        for(size_t j = tj * TILE_SIZE ; j < last_col ; j++)
+        {
+          result[i * n + j] = mat_dot(&mat1[i * w], &mat2t[j * w], w);
+        }
+      }
+    }
   }
 
-  /* to set spread way, add to next line: proc_bind(spread) */
-  #pragma omp parallel num_threads(threads)
-  for(size_t i = 0 ; i < m ; i++)
+  return 0;
+}
+
+/**
+ * \brief Recursion of task algorithm: splits the largest dimension in two
+ * until all of them are below cutoff. Halves of rows or columns of result
+ * are independent and run as tasks, halves of common dimension accumulate in
+ * the same result and run one after the other.
+ * \param a first matrix.
+ * \param lda row stride of first matrix.
+ * \param b second matrix.
+ * \param ldb row stride of second matrix.
+ * \param c result matrix.
+ * \param ldc row stride of result matrix.
+ * \param m row size of first matrix.
+ * \param n column size of second matrix.
+ * \param w column size of first matrix.
+ * \param cutoff size below which tasks are not spawned.
+ */
+static void mat_task_rec(const mat_elem_t* restrict a, size_t lda,
+    const mat_elem_t* restrict b, size_t ldb, mat_elem_t* restrict c,
+    size_t ldc, size_t m, size_t n, size_t w, size_t cutoff)
+{
+  if(m <= cutoff && n <= cutoff && w <= cutoff)
   {
-    #pragma omp for schedule(static)
-    for(size_t j = 0 ; j < n ; j++)
+    for(size_t i = 0 ; i < m ; i++)
     {
-      uint64_t tmp = 0;
+      mat_elem_t* restrict res = &c[i * ldc];
 
       for(size_t k = 0 ; k < w ; k++)
       {
-        tmp += mat1[i * w + k] * mat2[k * n + j];
-      }
+        mat_elem_t av = a[i * lda + k];
+        const mat_elem_t* restrict bk = &b[k * ldb];
 
-      result[i * m + j] = tmp;
+        #pragma omp simd
+        for(size_t j = 0 ; j < n ; j++)
+        {
+          res[j] += av * bk[j];
+        }
+      }
     }
   }
+  else if(w >= m && w >= n)
+  {
+    size_t h = w / 2;
+
+    mat_task_rec(a, lda, b, ldb, c, ldc, m, n, h, cutoff);
+    mat_task_rec(a + h, lda, b + h * ldb, ldb, c, ldc, m, n, w - h, cutoff);
+  }
+  else if(m >= n)
+  {
+    size_t h = m / 2;
+
+    #pragma omp task
+    mat_task_rec(a, lda, b, ldb, c, ldc, h, n, w, cutoff);
+    mat_task_rec(a + h * lda, lda, b, ldb, c + h * ldc, ldc, m - h, n, w,
+        cutoff);
+    #pragma omp taskwait
+  }
+  else
+  {
+    size_t h = n / 2;
+
+    #pragma omp task
+    mat_task_rec(a, lda, b, ldb, c, ldc, m, h, w, cutoff);
+    mat_task_rec(a, lda, b + h, ldb, c + h, ldc, m, n - h, w, cutoff);
+    #pragma omp taskwait
+  }
+}
+
+/**
+ * \brief Performs multiplication of matrixes with recursive tasks.
+ *
+ * Tasks are balanced by the work-stealing scheduler of the runtime, which
+ * copes better than static placement with oversubscribed or hyperthreaded
+ * CPUs.
+ * \param mat1 first matrix.
+ * \param mat2 second matrix.
+ * \param result result matrix.
+ * \param m row size of first matrix.
+ * \param n column size of second matrix.
+ * \param w column size of first matrix.
+ * \param threads thread number.
+ * \param cutoff size below which tasks are not spawned.
+ * \return 0.
+ */
+int mat_mult_omp_task(const mat_elem_t* restrict mat1,
+    const mat_elem_t* restrict mat2, mat_elem_t* restrict result, size_t m,
+    size_t n, size_t w, size_t threads, size_t cutoff)
+{
+  memset(result, 0x00, m * n * sizeof(mat_elem_t));
+
+  #pragma omp parallel num_threads(threads)
+  #pragma omp single
+  mat_task_rec(mat1, w, mat2, n, result, n, m, n, w, cutoff);
 
   return 0;
 }
 
+/**
+ * \brief Measures the mean cost of an OpenMP barrier for 1, 2, 4... up to
+ * threads threads and prints it with the overhead of one barrier per row of
+ * result (worksharing loop inside a row loop) and of a single barrier per
+ * multiplication.
+ * \param threads maximum thread number.
+ * \param m row size of first matrix.
+ */
+void mat_barrier_bench(size_t threads, size_t m)
+{
+  fprintf(stdout, "threads\tbarrier (us)\t%zu barriers (ms)\t"
+      "1 barrier (ms)\n", m);
+
+  for(size_t t = 1 ; t <= threads ; t = (t * 2 > threads && t < threads) ?
+      threads : t * 2)
+  {
+    double start = 0;
+    double cost = 0;
+
+    #pragma omp parallel num_threads(t)
+    {
+      /* warm-up so that threads are created before timing */
+      #pragma omp barrier
+      #pragma omp single
+      start = util_gettime_us();
+
+      for(size_t i = 0 ; i < BARRIER_RUNS ; i++)
+      {
+        #pragma omp barrier
+      }
+
+      #pragma omp single
+      cost = (util_gettime_us() - start) / BARRIER_RUNS;
+    }
+
+    fprintf(stdout, "%zu\t%f\t%f\t\t%f\n", t, cost, cost * m / 1000,
+        cost / 1000);
+  }
+}
+
+/**
+ * \brief Performs multiplication of matrixes with the shared packed kernel,
+ * each thread computing a contiguous slice of rows.
+ * \param mat1 first matrix.
+ * \param mat2 second matrix.
+ * \param result result matrix.
+ * \param m row size of first matrix.
+ * \param n column size of second matrix.
+ * \param w column size of first matrix.
+ * \param threads thread number.
+ * \return 0 if success, -1 if a kernel fails.
+ */
+int mat_mult_omp_packed(const mat_elem_t* restrict mat1,
+    const mat_elem_t* restrict mat2, mat_elem_t* restrict result, size_t m,
+    size_t n, size_t w, size_t threads)
+{
+  int status = 0;
+
+  #pragma omp parallel num_threads(threads) reduction(|:status)
+  {
+    size_t nb = omp_get_num_threads();
+    size_t idx = omp_get_thread_num();
+    size_t first_row = m * idx / nb;
+    size_t last_row = m * (idx + 1) / nb;
+
+    status |= mat_kernel_packed(mat1, mat2, result, m, n, w, first_row,
+        last_row);
+  }
+
+  return status ? -1 : 0;
+}
+
 /**
  * \brief Print help.
  * \param program program name.
  */
 void print_help(const char* program)
 {
-  fprintf(stdout, "Usage: %s [-m row size] [-t nb] "
-      "[-p] [-h]\n\n"
+  fprintf(stdout, "Usage: %s [-m size] [-M rows] [-K common] [-N columns] "
+      "[-t nb] [-a algorithm] [-S schedule] [-c cutoff] [-B] [-p] [-h]\n\n"
       "  -h\t\tDisplay this help\n"
       "  -p\t\tPrint the input and output matrixes\n"
-      "  -m row\tRow/column size (default 1024)\n"
-      "  -t nb\t\tNumber of threads to use\n", program);
+      "  -m size\tSize of square matrixes (default 1024)\n"
+      "  -M rows\tRow size of first matrix (default -m)\n"
+      "  -K common\tColumn size of first matrix (default -m)\n"
+      "  -N columns\tColumn size of second matrix (default -m)\n"
+      "  -t nb\t\tNumber of threads to use\n"
+      "  -a algo\tAlgorithm: naive, packed, task, transpose (default naive)\n"
+      "  -S sched\tSchedule of naive algorithm: static, dynamic, guided or\n"
+      "\t\tauto, with optional chunk (i.e. dynamic,4) (default static)\n"
+      "  -c cutoff\tSize below which task algorithm stops spawning tasks\n"
+      "\t\t(default %zu)\n"
+      "  -B\t\tMeasure barrier cost from 1 to -t threads and exit\n",
+      program, DEFAULT_TASK_CUTOFF);
 }
 
 /**
@@ -168,14 +508,27 @@ int parse_cmdline(int argc, char** argv,
   /*
    * h: print help and exit
    * p: print input and output matrixes
-   * m: row size
+   * m: square size
+   * M: row size of first matrix
+   * K: common dimension
+   * N: column size of second matrix
    * t: number of threads to use
+   * a: algorithm
+   * S: schedule
+   * B: barrier benchmark
+   * c: task cutoff
    */
-  static const char* options = "hpm:t:";
+  static const char* options = "hpm:M:K:N:t:a:S:Bc:";
   int opt = 0;
   int print_matrix = 0;
   long m = DEFAULT_ROW_SIZE;
+  long dims[3] = {0, 0, 0};
+  enum mat_algorithm algorithm = MAT_NAIVE;
   int threads = sysconf(_SC_NPROCESSORS_ONLN);
+  omp_sched_t schedule = omp_sched_static;
+  int chunk = 0;
+  int barrier_bench = 0;
+  long cutoff = DEFAULT_TASK_CUTOFF;
   int ret = 1;
 
   assert(configuration);
@@ -200,6 +553,16 @@ int parse_cmdline(int argc, char** argv,
           ret = -1;
         }
         break;
+      case 'M':
+      case 'K':
+      case 'N':
+        dims[opt == 'M' ? 0 : opt == 'K' ? 1 : 2] = atol(optarg);
+        if(atol(optarg) < 1)
+        {
+          fprintf(stderr, "Bad argument for '-%c': %s\n", opt, optarg);
+          ret = -1;
+        }
+        break;
       case 't':
         threads = atol(optarg);
         if(threads <= 0)
@@ -208,6 +571,75 @@ int parse_cmdline(int argc, char** argv,
           ret = EXIT_FAILURE;
         }
         break;
+      case 'S':
+      {
+        const char* comma = strchr(optarg, ',');
+        size_t len = comma ? (size_t)(comma - optarg) : strlen(optarg);
+
+        chunk = comma ? atoi(comma + 1) : 0;
+
+        if(len == 6 && !strncmp(optarg, "static", len))
+        {
+          schedule = omp_sched_static;
+        }
+        else if(len == 7 && !strncmp(optarg, "dynamic", len))
+        {
+          schedule = omp_sched_dynamic;
+        }
+        else if(len == 6 && !strncmp(optarg, "guided", len))
+        {
+          schedule = omp_sched_guided;
+        }
+        else if(len == 4 && !strncmp(optarg, "auto", len))
+        {
+          schedule = omp_sched_auto;
+        }
+        else
+        {
+          chunk = -1;
+        }
+
+        if(chunk < 0 || (comma && chunk == 0))
+        {
+          fprintf(stderr, "Bad argument for '-S': %s\n", optarg);
+          ret = -1;
+        }
+        break;
+      }
+      case 'B':
+        barrier_bench = 1;
+        break;
+      case 'c':
+        cutoff = atol(optarg);
+        if(cutoff < 1)
+        {
+          fprintf(stderr, "Bad argument for '-c': %s\n", optarg);
+          ret = -1;
+        }
+        break;
+      case 'a':
+        if(!strcmp(optarg, "naive"))
+        {
+          algorithm = MAT_NAIVE;
+        }
+        else if(!strcmp(optarg, "packed"))
+        {
+          algorithm = MAT_PACKED;
+        }
+        else if(!strcmp(optarg, "task"))
+        {
+          algorithm = MAT_TASK;
+        }
+        else if(!strcmp(optarg, "transpose"))
+        {
+          algorithm = MAT_TRANSPOSED;
+        }
+        else
+        {
+          fprintf(stderr, "Bad argument for '-a': %s\n", optarg);
+          ret = -1;
+        }
+        break;
       default:
         fprintf(stderr, "Bad option (%c)\n", optopt);
         ret = -1;
@@ -216,8 +648,15 @@ int parse_cmdline(int argc, char** argv,
   }
 
   configuration->print_matrix = print_matrix;
-  configuration->m = m;
+  configuration->m = dims[0] ? (size_t)dims[0] : (size_t)m;
+  configuration->w = dims[1] ? (size_t)dims[1] : (size_t)m;
+  configuration->n = dims[2] ? (size_t)dims[2] : (size_t)m;
   configuration->threads = (size_t)threads;
+  configuration->algorithm = algorithm;
+  configuration->schedule = schedule;
+  configuration->chunk = chunk;
+  configuration->barrier_bench = barrier_bench;
+  configuration->cutoff = (size_t)cutoff;
 
   return ret;
 }
@@ -230,9 +669,10 @@ int parse_cmdline(int argc, char** argv,
  */
 int main(int argc, char** argv)
 {
-  uint64_t* mat1 = NULL;
-  uint64_t* mat2 = NULL;
-  uint64_t* mat3 = NULL;
+  mat_elem_t* mat1 = NULL;
+  mat_elem_t* mat2 = NULL;
+  mat_elem_t* mat2t = NULL;
+  mat_elem_t* mat3 = NULL;
   size_t m = DEFAULT_ROW_SIZE;
   size_t n = DEFAULT_COLUMN_SIZE;
   size_t w = DEFAULT_COLUMN_SIZE;
@@ -242,7 +682,7 @@ int main(int argc, char** argv)
   double start = 0;
   double end = 0;
   int ret = 0;
-  int nb_elements = 0;
+  size_t nb_elements = 0;
 
   ret = parse_cmdline(argc, argv, &config);
 
@@ -256,16 +696,24 @@ int main(int argc, char** argv)
   }
 
   m = config.m;
-  n = config.m;
-  w = config.m;
+  n = config.n;
+  w = config.w;
   nb_elements = m * n;
 
   print_matrix = config.print_matrix;
   threads = config.threads;
 
-  mat1 = malloc(nb_elements * sizeof(uint64_t));
-  mat2 = malloc(nb_elements * sizeof(uint64_t));
-  mat3 = malloc(nb_elements * sizeof(uint64_t));
+  if(config.barrier_bench)
+  {
+    mat_barrier_bench(threads, m);
+    exit(EXIT_SUCCESS);
+  }
+
+  omp_set_schedule(config.schedule, config.chunk);
+
+  mat1 = mat_alloc(m * w);
+  mat2 = mat_alloc(w * n);
+  mat3 = mat_alloc(nb_elements);
 
   if(!mat1 || !mat2 || !mat3)
   {
@@ -276,20 +724,56 @@ int main(int argc, char** argv)
     exit(EXIT_FAILURE);
   }
 
-  mat_init(mat1, mat2, m, n);
+  mat_init(mat1, mat2, m, n, w);
 
   if(print_matrix)
   {
     printf("Matrix 1:\n");
-    mat_print(mat1, m, n);
+    mat_print(mat1, m, w);
     printf("Matrix 2:\n");
-    mat_print(mat2, m, n);
+    mat_print(mat2, w, n);
   }
 
   fprintf(stdout, "Compute with %zu thread(s)\n", threads);
 
+  if(config.algorithm == MAT_PACKED)
+  {
+    fprintf(stdout, "Packed kernel: %s\n", mat_kernel_default()->name);
+  }
+  else if(config.algorithm == MAT_TRANSPOSED)
+  {
+    mat2t = mat_transpose_timed(mat2, n, w, mat_transpose_omp, &threads);
+
+    if(!mat2t)
+    {
+      perror("malloc");
+      free(mat1);
+      free(mat2);
+      free(mat3);
+      exit(EXIT_FAILURE);
+    }
+  }
+
   start = util_gettime_us();
-  if(mat_mult_omp(mat1, mat2, mat3, m, n, w, threads) == -1)
+  if(config.algorithm == MAT_PACKED)
+  {
+    ret = mat_mult_omp_packed(mat1, mat2, mat3, m, n, w, threads);
+  }
+  else if(config.algorithm == MAT_TASK)
+  {
+    ret = mat_mult_omp_task(mat1, mat2, mat3, m, n, w, threads,
+        config.cutoff);
+  }
+  else if(config.algorithm == MAT_TRANSPOSED)
+  {
+    ret = mat_mult_omp_transposed(mat1, mat2t, mat3, m, n, w, threads);
+  }
+  else
+  {
+    ret = mat_mult_omp(mat1, mat2, mat3, m, n, w, threads);
+  }
+
+  if(ret == -1)
   {
     fprintf(stderr, "Matrixes cannot be multiplied\n");
     ret = EXIT_FAILURE;
@@ -310,6 +794,7 @@ int main(int argc, char** argv)
   /* free resources */
   free(mat1);
   free(mat2);
+  free(mat2t);
   free(mat3);
 
   return ret;
@@ -12,6 +12,11 @@
  * \date 2014-2017
  */
 
+#ifdef __linux__
+/* pthread_attr_setaffinity_np() */
+#define _GNU_SOURCE
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -20,11 +25,23 @@
 #include <errno.h>
 #include <assert.h>
 #include <time.h>
+#include <dirent.h>
 
 #include <sys/time.h>
 
+#ifdef __linux__
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
+
+#include <stdatomic.h>
+
 #include <pthread.h>
 
+#include "mat_type.h"
+#include "mat_kernel.h"
+#include "mat_transpose.h"
+
 /**
  * \brief Default row size.
  */
@@ -35,6 +52,83 @@ static const size_t DEFAULT_ROW_SIZE = 1024;
  */
 static const size_t DEFAULT_COLUMN_SIZE = 1024;
 
+/**
+ * \brief Side of result tiles handed out to workers (packed tiles span all
+ * columns).
+ */
+#define TILE_SIZE 64
+
+/**
+ * \brief Maximum number of CPUs handled for affinity.
+ */
+#define MAX_CPUS 1024
+
+/**
+ * \brief Directory of NUMA nodes in sysfs.
+ */
+#define NODE_DIR "/sys/devices/system/node"
+
+/**
+ * \enum mat_algorithm
+ * \brief Multiplication algorithm.
+ */
+enum mat_algorithm
+{
+  MAT_NAIVE = 0, /**< Textbook i-j-k loop (reference). */
+  MAT_PACKED, /**< Packed panels with register-blocked micro-kernel. */
+  MAT_TRANSPOSED /**< Dot products with transposed second matrix. */
+};
+
+/**
+ * \enum mat_affinity
+ * \brief Placement of workers on CPUs.
+ */
+enum mat_affinity
+{
+  MAT_AFFINITY_NONE = 0, /**< Left to the scheduler. */
+  MAT_AFFINITY_COMPACT, /**< Fill CPUs of a node before the next one. */
+  MAT_AFFINITY_SPREAD, /**< Round-robin over nodes. */
+  MAT_AFFINITY_LIST /**< Explicit list of CPUs. */
+};
+
+/**
+ * \enum mat_job
+ * \brief Job run by workers.
+ */
+enum mat_job
+{
+  MAT_JOB_MULT = 0, /**< Multiplication. */
+  MAT_JOB_INIT, /**< Initialization (first-touch) of matrixes. */
+  MAT_JOB_TRANSPOSE /**< Transposition of second matrix. */
+};
+
+/**
+ * \struct mat_topology
+ * \brief CPUs of the machine ordered by NUMA node.
+ */
+struct mat_topology
+{
+  /**
+   * \brief Number of CPUs.
+   */
+  size_t nb_cpus;
+
+  /**
+   * \brief Number of NUMA nodes with CPUs.
+   */
+  size_t nb_nodes;
+
+  /**
+   * \brief CPU identifiers, those of a node are contiguous.
+   */
+  int cpus[MAX_CPUS];
+
+  /**
+   * \brief Node of each CPU of cpus.
+   */
+  int nodes[MAX_CPUS];
+};
+
 /**
  * \struct configuration
  * \brief Configuration.
@@ -42,10 +136,20 @@ static const size_t DEFAULT_COLUMN_SIZE = 1024;
 struct configuration
 {
   /**
-   * \brief Row/column size.
+   * \brief Row size of first matrix.
    */
   size_t m;
 
+  /**
+   * \brief Column size of second matrix.
+   */
+  size_t n;
+
+  /**
+   * \brief Common dimension (column size of first matrix).
+   */
+  size_t w;
+
   /**
    * \brief Print input and output matrixes.
    */
@@ -55,6 +159,31 @@ struct configuration
    * \brief Number of threads.
    */
   size_t threads;
+
+  /**
+   * \brief Multiplication algorithm.
+   */
+  enum mat_algorithm algorithm;
+
+  /**
+   * \brief Number of multiplications to run.
+   */
+  size_t repeat;
+
+  /**
+   * \brief Placement of workers.
+   */
+  enum mat_affinity affinity;
+
+  /**
+   * \brief CPUs for MAT_AFFINITY_LIST.
+   */
+  int cpus[MAX_CPUS];
+
+  /**
+   * \brief Number of CPUs in cpus.
+   */
+  size_t nb_cpus;
 };
 
 /**
@@ -70,17 +199,17 @@ struct mat_mult_data
   /**
    * \brief First matrix.
    */
-  uint64_t* mat1;
+  mat_elem_t* mat1;
 
   /**
    * \brief Second matrix.
    */
-  uint64_t* mat2;
+  mat_elem_t* mat2;
 
   /**
    * \brief Result matrix.
    */
-  uint64_t* result;
+  mat_elem_t* result;
 
   /**
    * \brief Row size.
@@ -101,6 +230,97 @@ struct mat_mult_data
    * \brief Number of threads.
    */
   size_t threads;
+
+  /**
+   * \brief Multiplication algorithm.
+   */
+  enum mat_algorithm algorithm;
+
+  /**
+   * \brief Status of the worker (0 if success, -1 otherwise).
+   */
+  int status;
+
+  /**
+   * \brief Job to run.
+   */
+  enum mat_job job;
+
+  /**
+   * \brief CPU the worker is bound to (-1 if none).
+   */
+  int cpu;
+
+  /**
+   * \brief Next tile to compute in each band, shared by all workers of a
+   * job.
+   */
+  atomic_size_t* next_tile;
+
+  /**
+   * \brief Pool the worker belongs to (NULL for one-shot threads).
+   */
+  struct mat_pool* pool;
+};
+
+/**
+ * \struct mat_pool
+ * \brief Persistent pool of workers.
+ *
+ * Workers are created once and wait on a condition variable between
+ * multiplications, so that a call only costs a wake-up and a barrier.
+ */
+struct mat_pool
+{
+  /**
+   * \brief Thread identifiers.
+   */
+  pthread_t* ids;
+
+  /**
+   * \brief Per-worker data, job is set here before each wake-up.
+   */
+  struct mat_mult_data* datas;
+
+  /**
+   * \brief Number of threads.
+   */
+  size_t threads;
+
+  /**
+   * \brief Mutex protecting the fields below.
+   */
+  pthread_mutex_t mutex;
+
+  /**
+   * \brief Signaled when a job is posted or pool is shut down.
+   */
+  pthread_cond_t job_cond;
+
+  /**
+   * \brief Signaled when the last worker finishes a job.
+   */
+  pthread_cond_t done_cond;
+
+  /**
+   * \brief Incremented for each job so that workers detect new ones.
+   */
+  unsigned long generation;
+
+  /**
+   * \brief Number of workers still running current job.
+   */
+  size_t pending;
+
+  /**
+   * \brief Next tile of each band for current job.
+   */
+  atomic_size_t* next_tile;
+
+  /**
+   * \brief Set to stop workers.
+   */
+  int shutdown;
 };
 
 /**
@@ -114,46 +334,135 @@ static double util_gettime_us(void)
     return t.tv_sec * 1000000 + t.tv_usec;
 }
 
+/**
+ * \brief Returns the tile rows of a band. Rows of tiles are split in one band
+ * per worker, each worker first-touches (see mat_init_work()) and computes
+ * its own band.
+ * \param m row size of first matrix.
+ * \param threads number of threads.
+ * \param band index of band.
+ * \param first first tile row of band.
+ * \param last tile row after the last one of band.
+ */
+static void mat_band(size_t m, size_t threads, size_t band, size_t* first,
+    size_t* last)
+{
+  size_t tiles_m = (m + TILE_SIZE - 1) / TILE_SIZE;
+
+  *first = band * tiles_m / threads;
+  *last = (band + 1) * tiles_m / threads;
+}
+
 /**
  * \brief Thread worker to calculate matrix.
+ *
+ * Result is split in tiles taken from per-band atomic counters. A worker
+ * takes tiles of its own band, whose rows are on its NUMA node, then steals
+ * from the other bands so that a slow worker (preempted or on a slower core)
+ * only delays its own tile. Packed algorithm takes whole bands instead of
+ * tiles, packing of second matrix being paid once per band.
  * \param data data.
  * \return NULL;
  */
 static void* mat_mult_work(void* data)
 {
   struct mat_mult_data* d = (struct mat_mult_data*)data;
-  uint64_t* mat1 = d->mat1;
-  uint64_t* mat2 = d->mat2;
-  uint64_t* result = d->result;
+  const mat_elem_t* restrict mat1 = d->mat1;
+  const mat_elem_t* restrict mat2 = d->mat2;
+  mat_elem_t* restrict result = d->result;
   size_t m = d->m;
   size_t n = d->n;
   size_t w = d->w;
+  size_t tiles_n = (n + TILE_SIZE - 1) / TILE_SIZE;
 
-  size_t step = m / d->threads;
-
-  if(step == 0)
+  if(m == 0 || n == 0)
   {
-    step = 1;
+    return NULL;
+  }
 
-    /* exit threads that will not work */
-    if(d->idx >= m)
+  if(d->algorithm == MAT_PACKED)
+  {
+    /* a whole band goes in one call so that second matrix is packed once per
+     * band, not once per tile, bands are still stolen from slow workers
+     */
+    for(size_t s = 0 ; s < d->threads ; s++)
     {
-      return NULL;
+      size_t band = (d->idx + s) % d->threads;
+      size_t first = 0;
+      size_t last = 0;
+
+      mat_band(m, d->threads, band, &first, &last);
+
+      if(first == last || atomic_fetch_add_explicit(&d->next_tile[band], 1,
+            memory_order_relaxed) != 0)
+      {
+        continue;
+      }
+
+      if(mat_kernel_packed(mat1, mat2, result, m, n, w, first * TILE_SIZE,
+            last * TILE_SIZE < m ? last * TILE_SIZE : m) != 0)
+      {
+        d->status = -1;
+      }
     }
+    return NULL;
   }
 
-  for(size_t i = d->idx * step ; i < (d->idx + 1) * step && i < m; i++)
+  for(size_t s = 0 ; s < d->threads ; s++)
   {
-    for(size_t j = 0 ; j < n ; j++)
+    size_t band = (d->idx + s) % d->threads;
+    size_t first = 0;
+    size_t last = 0;
+
+    mat_band(m, d->threads, band, &first, &last);
+
+    for(;;)
     {
-      uint64_t tmp = 0;
+      /* result is published by the join or the pool mutex */
+      size_t tile = atomic_fetch_add_explicit(&d->next_tile[band], 1,
+          memory_order_relaxed);
+      size_t first_row = 0;
+      size_t last_row = 0;
+      size_t first_col = 0;
+      size_t last_col = 0;
+
+      if(tile >= (last - first) * tiles_n)
+      {
+        break;
+      }
+
+      first_row = (first + tile / tiles_n) * TILE_SIZE;
+      last_row = first_row + TILE_SIZE < m ? first_row + TILE_SIZE : m;
+      first_col = (tile % tiles_n) * TILE_SIZE;
+      last_col = first_col + TILE_SIZE < n ? first_col + TILE_SIZE : n;
 
-      for(size_t k = 0 ; k < w ; k++)
+      if(d->algorithm == MAT_TRANSPOSED)
       {
-        tmp += mat1[i * w + k] * mat2[k * n + j];
+        /* second matrix is transposed (n x w) */
+        for(size_t i = first_row ; i < last_row ; i++)
+        {
+          for(size_t j = first_col ; j < last_col ; j++)
+          {
+            result[i * n + j] = mat_dot(&mat1[i * w], &mat2[j * w], w);
+          }
+        }
+        continue;
       }
 
-      result[i * m + j] = tmp;
+      for(size_t i = first_row ; i < last_row ; i++)
+      {
+        for(size_t j = first_col ; j < last_col ; j++)
+        {
+          mat_elem_t tmp = 0;
+
+          for(size_t k = 0 ; k < w ; k++)
+          {
+            tmp += mat1[i * w + k] * mat2[k * n + j];
+          }
+
+          result[i * n + j] = tmp;
+        }
+      }
     }
   }
 
@@ -161,19 +470,584 @@ static void* mat_mult_work(void* data)
 }
 
 /**
- * \brief Initializes the matrixes.
+ * \brief Thread worker to initialize matrixes. Pages are placed on the NUMA
+ * node of the first thread that writes them, so each worker writes rows of
+ * first and result matrixes of its band, and an even part of second matrix.
+ * \param d data.
+ */
+static void mat_init_work(struct mat_mult_data* d)
+{
+  size_t first = 0;
+  size_t last = 0;
+  size_t first_row = 0;
+  size_t last_row = 0;
+
+  mat_band(d->m, d->threads, d->idx, &first, &last);
+  first_row = first * TILE_SIZE < d->m ? first * TILE_SIZE : d->m;
+  last_row = last * TILE_SIZE < d->m ? last * TILE_SIZE : d->m;
+
+  for(size_t i = first_row * d->w ; i < last_row * d->w ; i++)
+  {
+    d->mat1[i] = MAT_ELEM_INIT(i);
+  }
+
+  memset(&d->result[first_row * d->n], 0x00,
+      (last_row - first_row) * d->n * sizeof(mat_elem_t));
+
+  first_row = d->idx * d->w / d->threads;
+  last_row = (d->idx + 1) * d->w / d->threads;
+
+  for(size_t i = first_row * d->n ; i < last_row * d->n ; i++)
+  {
+    d->mat2[i] = MAT_ELEM_INIT(i);
+  }
+}
+
+/**
+ * \brief Loop of pool workers: waits for a job, runs it and reports its
+ * completion until the pool is shut down.
+ * \param data data.
+ * \return NULL.
+ */
+static void* mat_pool_work(void* data)
+{
+  struct mat_mult_data* d = (struct mat_mult_data*)data;
+  struct mat_pool* pool = d->pool;
+  unsigned long generation = 0;
+
+  pthread_mutex_lock(&pool->mutex);
+
+  for(;;)
+  {
+    while(pool->generation == generation && !pool->shutdown)
+    {
+      pthread_cond_wait(&pool->job_cond, &pool->mutex);
+    }
+
+    if(pool->shutdown)
+    {
+      break;
+    }
+
+    generation = pool->generation;
+    pthread_mutex_unlock(&pool->mutex);
+
+    if(d->job == MAT_JOB_INIT)
+    {
+      mat_init_work(d);
+    }
+    else if(d->job == MAT_JOB_TRANSPOSE)
+    {
+      /* each worker transposes an even part of rows of second matrix */
+      mat_transpose(d->mat2, d->result, d->w, d->n,
+          d->idx * d->w / d->threads, (d->idx + 1) * d->w / d->threads);
+    }
+    else
+    {
+      mat_mult_work(d);
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    if(--pool->pending == 0)
+    {
+      pthread_cond_signal(&pool->done_cond);
+    }
+  }
+
+  pthread_mutex_unlock(&pool->mutex);
+  return NULL;
+}
+
+/**
+ * \brief Stops and joins the workers of a pool and frees its resources.
+ * \param pool the pool.
+ */
+void mat_pool_destroy(struct mat_pool* pool)
+{
+  pthread_mutex_lock(&pool->mutex);
+  pool->shutdown = 1;
+  pthread_cond_broadcast(&pool->job_cond);
+  pthread_mutex_unlock(&pool->mutex);
+
+  for(size_t i = 0 ; i < pool->threads ; i++)
+  {
+    pthread_join(pool->ids[i], NULL);
+  }
+
+  pthread_cond_destroy(&pool->done_cond);
+  pthread_cond_destroy(&pool->job_cond);
+  pthread_mutex_destroy(&pool->mutex);
+  free(pool->ids);
+  free(pool->datas);
+  free(pool->next_tile);
+  pool->ids = NULL;
+  pool->datas = NULL;
+  pool->next_tile = NULL;
+  pool->threads = 0;
+}
+
+/**
+ * \brief Creates the workers of a pool.
+ * \param pool the pool.
+ * \param threads thread number.
+ * \param cpus CPU of each worker, NULL to let the scheduler place them.
+ * \return 0 if success, -1 if memory or a thread cannot be allocated.
+ */
+int mat_pool_init(struct mat_pool* pool, size_t threads, const int* cpus)
+{
+  memset(pool, 0x00, sizeof(struct mat_pool));
+  pool->ids = malloc(threads * sizeof(pthread_t));
+  pool->datas = calloc(threads, sizeof(struct mat_mult_data));
+  pool->next_tile = malloc(threads * sizeof(atomic_size_t));
+
+  if(!pool->ids || !pool->datas || !pool->next_tile)
+  {
+    free(pool->ids);
+    free(pool->datas);
+    free(pool->next_tile);
+    return -1;
+  }
+
+  for(size_t i = 0 ; i < threads ; i++)
+  {
+    atomic_init(&pool->next_tile[i], 0);
+  }
+
+  pthread_mutex_init(&pool->mutex, NULL);
+  pthread_cond_init(&pool->job_cond, NULL);
+  pthread_cond_init(&pool->done_cond, NULL);
+
+  for(size_t i = 0 ; i < threads ; i++)
+  {
+    pthread_attr_t attr;
+    int ret = 0;
+
+    pool->datas[i].idx = i;
+    pool->datas[i].pool = pool;
+    pool->datas[i].next_tile = pool->next_tile;
+    pool->datas[i].cpu = cpus ? cpus[i] : -1;
+
+    pthread_attr_init(&attr);
+
+#ifdef __linux__
+    if(cpus)
+    {
+      cpu_set_t set;
+
+      CPU_ZERO(&set);
+      CPU_SET(cpus[i], &set);
+      pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &set);
+    }
+#endif
+
+    ret = pthread_create(&pool->ids[i], &attr, mat_pool_work,
+        &pool->datas[i]);
+    pthread_attr_destroy(&attr);
+
+    if(ret != 0)
+    {
+      errno = ret;
+      perror("pthread_create error");
+      mat_pool_destroy(pool);
+      return -1;
+    }
+
+    /* so that destroy only joins created threads */
+    pool->threads = i + 1;
+  }
+
+  return 0;
+}
+
+/**
+ * \brief Runs a job with the workers of a pool and waits for them.
+ * \param pool the pool.
+ * \param job job to run.
  * \param mat1 first matrix.
  * \param mat2 second matrix.
- * \param m row size of the matrix.
- * \param n column size of the matrix.
+ * \param result result matrix.
+ * \param m row size of first matrix.
+ * \param n column size of second matrix.
+ * \param w column size of first matrix.
+ * \param algorithm multiplication algorithm run by each thread.
+ * \return 0 if success, -1 if a worker fails.
+ */
+static int mat_pool_run(struct mat_pool* pool, enum mat_job job,
+    mat_elem_t* mat1, mat_elem_t* mat2, mat_elem_t* result, size_t m,
+    size_t n, size_t w, enum mat_algorithm algorithm)
+{
+  int status = 0;
+
+  pthread_mutex_lock(&pool->mutex);
+
+  for(size_t i = 0 ; i < pool->threads ; i++)
+  {
+    struct mat_mult_data* d = &pool->datas[i];
+
+    d->mat1 = mat1;
+    d->mat2 = mat2;
+    d->result = result;
+    d->m = m;
+    d->n = n;
+    d->w = w;
+    d->threads = pool->threads;
+    d->algorithm = algorithm;
+    d->job = job;
+    d->status = 0;
+    atomic_store(&pool->next_tile[i], 0);
+  }
+
+  pool->pending = pool->threads;
+  pool->generation++;
+  pthread_cond_broadcast(&pool->job_cond);
+
+  while(pool->pending)
+  {
+    pthread_cond_wait(&pool->done_cond, &pool->mutex);
+  }
+
+  for(size_t i = 0 ; i < pool->threads ; i++)
+  {
+    if(pool->datas[i].status != 0)
+    {
+      status = -1;
+    }
+  }
+
+  pthread_mutex_unlock(&pool->mutex);
+  return status;
+}
+
+/**
+ * \brief Performs multiplication of matrixes with the workers of a pool.
+ * \param pool the pool.
+ * \param mat1 first matrix.
+ * \param mat2 second matrix.
+ * \param result result matrix.
+ * \param m row size of first matrix.
+ * \param n column size of second matrix.
+ * \param w column size of first matrix.
+ * \param algorithm multiplication algorithm run by each thread.
+ * \return 0 if success, -1 if a worker fails.
+ */
+int mat_pool_mult(struct mat_pool* pool, mat_elem_t* mat1, mat_elem_t* mat2,
+    mat_elem_t* result, size_t m, size_t n, size_t w,
+    enum mat_algorithm algorithm)
+{
+  return mat_pool_run(pool, MAT_JOB_MULT, mat1, mat2, result, m, n, w,
+      algorithm);
+}
+
+/**
+ * \brief Initializes the matrixes with the workers of a pool, so that pages
+ * of each band are on the NUMA node of the worker that computes it. Result
+ * matrix is zeroed.
+ * \param pool the pool.
+ * \param mat1 first matrix.
+ * \param mat2 second matrix.
+ * \param result result matrix.
+ * \param m row size of first matrix.
+ * \param n column size of second matrix.
+ * \param w column size of first matrix.
+ */
+void mat_pool_init_matrixes(struct mat_pool* pool, mat_elem_t* mat1,
+    mat_elem_t* mat2, mat_elem_t* result, size_t m, size_t n, size_t w)
+{
+  mat_pool_run(pool, MAT_JOB_INIT, mat1, mat2, result, m, n, w, MAT_NAIVE);
+}
+
+/**
+ * \brief Transposes second matrix with the workers of a pool.
+ * \param mat2 second matrix (w x n).
+ * \param mat2t transposed second matrix (n x w).
+ * \param n column size of second matrix.
+ * \param w row size of second matrix.
+ * \param arg the pool.
+ */
+void mat_pool_transpose(const mat_elem_t* restrict mat2,
+    mat_elem_t* restrict mat2t, size_t n, size_t w, void* arg)
+{
+  /* workers only read second matrix for this job */
+  mat_pool_run(arg, MAT_JOB_TRANSPOSE, NULL, (mat_elem_t*)mat2, mat2t, 0, n,
+      w, MAT_NAIVE);
+}
+
+/**
+ * \brief Parses a list of CPUs (i.e. "0,2,4-7").
+ * \param str the list.
+ * \param cpus array filled with CPUs.
+ * \param max size of cpus.
+ * \return number of CPUs or 0 if list is invalid or too long.
+ */
+size_t mat_parse_cpulist(const char* str, int* cpus, size_t max)
+{
+  size_t nb = 0;
+
+  while(*str && *str != '\n')
+  {
+    char* end = NULL;
+    long first = strtol(str, &end, 10);
+    long last = first;
+
+    if(end == str || first < 0)
+    {
+      return 0;
+    }
+
+    if(*end == '-')
+    {
+      str = end + 1;
+      last = strtol(str, &end, 10);
+
+      if(end == str || last < first)
+      {
+        return 0;
+      }
+    }
+
+    for(long cpu = first ; cpu <= last ; cpu++)
+    {
+      if(nb == max)
+      {
+        return 0;
+      }
+      cpus[nb++] = (int)cpu;
+    }
+
+    str = *end == ',' ? end + 1 : end;
+  }
+
+  return nb;
+}
+
+/**
+ * \brief Reads CPUs of each NUMA node from sysfs. Machines without NUMA
+ * information are seen as a single node with all online CPUs.
+ * \param topo topology filled.
  */
-void mat_init(uint64_t* mat1, uint64_t* mat2, size_t m, size_t n)
+void mat_topology_load(struct mat_topology* topo)
 {
-  for(size_t i = 0 ; i < (m * n) ; i++)
+  int max_node = -1;
+  DIR* dir = opendir(NODE_DIR);
+
+  topo->nb_cpus = 0;
+  topo->nb_nodes = 0;
+
+  if(dir)
+  {
+    struct dirent* entry = NULL;
+
+    while((entry = readdir(dir)))
+    {
+      int node = -1;
+
+      if(sscanf(entry->d_name, "node%d", &node) == 1 && node > max_node)
+      {
+        max_node = node;
+      }
+    }
+    closedir(dir);
+  }
+
+  for(int node = 0 ; node <= max_node ; node++)
   {
-    mat1[i] = i;
-    mat2[i] = i;
+    char path[128];
+    char buf[4096];
+    FILE* f = NULL;
+    size_t nb = 0;
+
+    snprintf(path, sizeof(path), NODE_DIR "/node%d/cpulist", node);
+    f = fopen(path, "r");
+
+    if(!f)
+    {
+      continue;
+    }
+
+    if(fgets(buf, sizeof(buf), f))
+    {
+      nb = mat_parse_cpulist(buf, &topo->cpus[topo->nb_cpus],
+          MAX_CPUS - topo->nb_cpus);
+    }
+    fclose(f);
+
+    for(size_t i = 0 ; i < nb ; i++)
+    {
+      topo->nodes[topo->nb_cpus + i] = node;
+    }
+
+    topo->nb_cpus += nb;
+    topo->nb_nodes += nb ? 1 : 0;
   }
+
+  if(topo->nb_cpus == 0)
+  {
+    long nb = sysconf(_SC_NPROCESSORS_ONLN);
+
+    for(long i = 0 ; i < nb && i < MAX_CPUS ; i++)
+    {
+      topo->cpus[i] = (int)i;
+      topo->nodes[i] = 0;
+    }
+
+    topo->nb_cpus = nb > 0 ? (nb < MAX_CPUS ? (size_t)nb : MAX_CPUS) : 1;
+    topo->nb_nodes = 1;
+  }
+}
+
+/**
+ * \brief Returns the NUMA node of a CPU.
+ * \param topo topology.
+ * \param cpu the CPU.
+ * \return node or -1 if unknown.
+ */
+int mat_topology_node(const struct mat_topology* topo, int cpu)
+{
+  for(size_t i = 0 ; i < topo->nb_cpus ; i++)
+  {
+    if(topo->cpus[i] == cpu)
+    {
+      return topo->nodes[i];
+    }
+  }
+
+  return -1;
+}
+
+/**
+ * \brief Computes the CPU of each worker.
+ * \param topo topology.
+ * \param config configuration (affinity policy and CPU list).
+ * \param cpus array of config->threads CPUs filled.
+ */
+void mat_affinity_cpus(const struct mat_topology* topo,
+    const struct configuration* config, int* cpus)
+{
+  for(size_t i = 0 ; i < config->threads ; i++)
+  {
+    if(config->affinity == MAT_AFFINITY_LIST)
+    {
+      cpus[i] = config->cpus[i % config->nb_cpus];
+    }
+    else if(config->affinity == MAT_AFFINITY_SPREAD)
+    {
+      /* (i / nodes)-th CPU of node (i % nodes) */
+      size_t node = i % topo->nb_nodes;
+      size_t first = 0;
+      size_t count = 0;
+
+      for(size_t j = 0, k = 0 ; j < topo->nb_cpus ; j++)
+      {
+        if(j > 0 && topo->nodes[j] != topo->nodes[j - 1])
+        {
+          k++;
+        }
+
+        if(k == node)
+        {
+          first = count ? first : j;
+          count++;
+        }
+      }
+
+      cpus[i] = topo->cpus[first + (i / topo->nb_nodes) % count];
+    }
+    else
+    {
+      cpus[i] = topo->cpus[i % topo->nb_cpus];
+    }
+  }
+}
+
+/**
+ * \brief Counts the pages of first and result matrixes that are on the NUMA
+ * node of the worker whose band they belong to, and the others. Each worker
+ * streams the rows of its band, so remote pages give remote memory traffic.
+ * \param pool the pool (workers bound to CPUs).
+ * \param topo topology.
+ * \param mat1 first matrix.
+ * \param result result matrix.
+ * \param m row size of first matrix.
+ * \param n column size of second matrix.
+ * \param w column size of first matrix.
+ * \param local number of local pages.
+ * \param remote number of remote pages.
+ * \return 0 if success, -1 if page placement cannot be queried.
+ */
+int mat_numa_pages(const struct mat_pool* pool,
+    const struct mat_topology* topo, const mat_elem_t* mat1,
+    const mat_elem_t* result, size_t m, size_t n, size_t w, size_t* local,
+    size_t* remote)
+{
+#ifdef SYS_move_pages
+  uintptr_t page_size = (uintptr_t)sysconf(_SC_PAGESIZE);
+
+  *local = 0;
+  *remote = 0;
+
+  for(size_t i = 0 ; i < pool->threads ; i++)
+  {
+    int node = mat_topology_node(topo, pool->datas[i].cpu);
+    size_t first = 0;
+    size_t last = 0;
+    const mat_elem_t* mats[2] = {mat1, result};
+    size_t cols[2] = {w, n};
+
+    mat_band(m, pool->threads, i, &first, &last);
+    first = first * TILE_SIZE < m ? first * TILE_SIZE : m;
+    last = last * TILE_SIZE < m ? last * TILE_SIZE : m;
+
+    for(size_t j = 0 ; j < 2 && first < last ; j++)
+    {
+      uintptr_t addr = (uintptr_t)&mats[j][first * cols[j]] &
+        ~(page_size - 1);
+      uintptr_t end = (uintptr_t)&mats[j][last * cols[j]];
+
+      while(addr < end)
+      {
+        void* pages[256];
+        int status[256];
+        size_t nb = 0;
+
+        for( ; nb < 256 && addr < end ; nb++, addr += page_size)
+        {
+          pages[nb] = (void*)addr;
+        }
+
+        /* with no target nodes, move_pages returns the node of each page */
+        if(syscall(SYS_move_pages, 0, nb, pages, NULL, status, 0) != 0)
+        {
+          return -1;
+        }
+
+        for(size_t k = 0 ; k < nb ; k++)
+        {
+          if(status[k] == node)
+          {
+            (*local)++;
+          }
+          else if(status[k] >= 0)
+          {
+            (*remote)++;
+          }
+        }
+      }
+    }
+  }
+
+  return 0;
+#else
+  (void)pool;
+  (void)topo;
+  (void)mat1;
+  (void)result;
+  (void)m;
+  (void)n;
+  (void)w;
+  (void)local;
+  (void)remote;
+  return -1;
+#endif
 }
 
 /**
@@ -182,13 +1056,13 @@ void mat_init(uint64_t* mat1, uint64_t* mat2, size_t m, size_t n)
  * \param m row size of the matrix.
  * \param n column size of the matrix.
  */
-void mat_print(uint64_t* mat, size_t m, size_t n)
+void mat_print(mat_elem_t* mat, size_t m, size_t n)
 {
   for(size_t i = 0 ; i < m ; i++)
   {
     for(size_t j = 0 ; j < n ; j++)
     {
-      fprintf(stdout, "%lu ", mat[i * m + j]);
+      fprintf(stdout, MAT_ELEM_FMT " ", mat[i * n + j]);
     }
     fprintf(stdout, "\n");
   }
@@ -200,21 +1074,20 @@ void mat_print(uint64_t* mat, size_t m, size_t n)
  * \param mat2 second matrix.
  * \param result result matrix.
  * \param m row size of first matrix.
- * \param n column size of first matrix.
- * \param w row size of second matrix.
+ * \param n column size of second matrix.
+ * \param w column size of first matrix.
  * \param threads thread number.
- * \return 0 if success, -1 if matrixes cannot be multiplied.
+ * \param algorithm multiplication algorithm run by each thread.
+ * \return 0 if success, -1 if a thread cannot be created or fails.
  */
-int mat_mult_pthread(uint64_t* mat1, uint64_t* mat2, uint64_t* result, size_t m,
-    size_t n, size_t w, size_t threads)
+int mat_mult_pthread(mat_elem_t* mat1, mat_elem_t* mat2, mat_elem_t* result,
+    size_t m, size_t n, size_t w, size_t threads,
+    enum mat_algorithm algorithm)
 {
   pthread_t ids[threads];
   struct mat_mult_data datas[threads];
-
-  if(n != w)
-  {
-    return -1;
-  }
+  atomic_size_t next_tile[threads];
+  int status = 0;
 
   for(size_t i = 0 ; i < threads ; i++)
   {
@@ -228,6 +1101,13 @@ int mat_mult_pthread(uint64_t* mat1, uint64_t* mat2, uint64_t* result, size_t m,
     datas[i].n = n;
     datas[i].w = w;
     datas[i].threads = threads;
+    datas[i].algorithm = algorithm;
+    datas[i].status = 0;
+    datas[i].job = MAT_JOB_MULT;
+    datas[i].cpu = -1;
+    datas[i].next_tile = next_tile;
+    datas[i].pool = NULL;
+    atomic_init(&next_tile[i], 0);
 
     ret = pthread_create(&ids[i], NULL, mat_mult_work, &datas[i]);
 
@@ -235,16 +1115,54 @@ int mat_mult_pthread(uint64_t* mat1, uint64_t* mat2, uint64_t* result, size_t m,
     {
       errno = ret;
       perror("pthread_create error");
-      return -1;
+
+      /* wait for threads already working on matrixes */
+      threads = i;
+      status = -1;
+      break;
     }
   }
 
   for(size_t i = 0 ; i < threads ; i++)
   {
     pthread_join(ids[i], NULL);
+
+    if(datas[i].status != 0)
+    {
+      status = -1;
+    }
   }
 
-  return 0;
+  return status;
+}
+
+/**
+ * \brief Measures the mean time to dispatch an empty job to workers and wait
+ * for them, with a pool and with threads created and joined per call.
+ * \param pool the pool.
+ * \param count number of jobs.
+ * \param pool_us mean time with the pool in microseconds.
+ * \param create_us mean time with create/join in microseconds.
+ */
+void mat_pool_latency(struct mat_pool* pool, size_t count, double* pool_us,
+    double* create_us)
+{
+  double start = 0;
+
+  /* with no row, workers return as soon as they are woken up */
+  start = util_gettime_us();
+  for(size_t i = 0 ; i < count ; i++)
+  {
+    mat_pool_mult(pool, NULL, NULL, NULL, 0, 0, 0, MAT_NAIVE);
+  }
+  *pool_us = (util_gettime_us() - start) / count;
+
+  start = util_gettime_us();
+  for(size_t i = 0 ; i < count ; i++)
+  {
+    mat_mult_pthread(NULL, NULL, NULL, 0, 0, 0, pool->threads, MAT_NAIVE);
+  }
+  *create_us = (util_gettime_us() - start) / count;
 }
 
 /**
@@ -253,12 +1171,21 @@ int mat_mult_pthread(uint64_t* mat1, uint64_t* mat2, uint64_t* result, size_t m,
  */
 void print_help(const char* program)
 {
-  fprintf(stdout, "Usage: %s [-m row size] [-t nb] "
-      "[-p] [-h]\n\n"
+  fprintf(stdout, "Usage: %s [-m size] [-M rows] [-K common] [-N columns] "
+      "[-t nb] [-a algorithm] [-r count] [-A affinity] [-p] [-h]\n\n"
       "  -h\t\tDisplay this help\n"
       "  -p\t\tPrint the input and output matrixes\n"
-      "  -m row\tRow/column size (default 1024)\n"
-      "  -t nb\t\tNumber of threads to use\n", program);
+      "  -m size\tSize of square matrixes (default 1024)\n"
+      "  -M rows\tRow size of first matrix (default -m)\n"
+      "  -K common\tColumn size of first matrix (default -m)\n"
+      "  -N columns\tColumn size of second matrix (default -m)\n"
+      "  -t nb\t\tNumber of threads to use\n"
+      "  -a algo\tAlgorithm: naive, packed, transpose (default naive)\n"
+      "  -r count\tNumber of multiplications run by the thread pool, also\n"
+      "\t\tmeasures dispatch latency (default 1)\n"
+      "  -A affinity\tPlacement of threads: compact, spread or a list of\n"
+      "\t\tCPUs (i.e. 0,2,4-7), reports NUMA placement of pages\n",
+      program);
 }
 
 /**
@@ -274,18 +1201,30 @@ int parse_cmdline(int argc, char** argv,
   /*
    * h: print help and exit
    * p: print input and output matrixes
-   * m: row size
+   * m: square size
+   * M: row size of first matrix
+   * K: common dimension
+   * N: column size of second matrix
    * t: number of threads to use
+   * a: algorithm
+   * r: number of multiplications
+   * A: affinity
    */
-  static const char* options = "hpm:t:";
+  static const char* options = "hpm:M:K:N:t:a:r:A:";
   int opt = 0;
   int print_matrix = 0;
   long m = DEFAULT_ROW_SIZE;
+  long dims[3] = {0, 0, 0};
+  enum mat_algorithm algorithm = MAT_NAIVE;
   int ret = 1;
   int threads = sysconf(_SC_NPROCESSORS_ONLN);
+  long repeat = 1;
+  enum mat_affinity affinity = MAT_AFFINITY_NONE;
 
   assert(configuration);
 
+  configuration->nb_cpus = 0;
+
   while((opt = getopt(argc, argv, options)) != -1)
   {
     switch(opt)
@@ -306,6 +1245,16 @@ int parse_cmdline(int argc, char** argv,
           ret = -1;
         }
         break;
+      case 'M':
+      case 'K':
+      case 'N':
+        dims[opt == 'M' ? 0 : opt == 'K' ? 1 : 2] = atol(optarg);
+        if(atol(optarg) < 1)
+        {
+          fprintf(stderr, "Bad argument for '-%c': %s\n", opt, optarg);
+          ret = -1;
+        }
+        break;
       case 't':
         threads = atol(optarg);
         if(threads <= 0)
@@ -314,6 +1263,53 @@ int parse_cmdline(int argc, char** argv,
           ret = EXIT_FAILURE;
         }
         break;
+      case 'r':
+        repeat = atol(optarg);
+        if(repeat < 1)
+        {
+          fprintf(stderr, "Bad argument for '-r': %s\n", optarg);
+          ret = -1;
+        }
+        break;
+      case 'A':
+        if(!strcmp(optarg, "compact"))
+        {
+          affinity = MAT_AFFINITY_COMPACT;
+        }
+        else if(!strcmp(optarg, "spread"))
+        {
+          affinity = MAT_AFFINITY_SPREAD;
+        }
+        else if((configuration->nb_cpus = mat_parse_cpulist(optarg,
+                configuration->cpus, MAX_CPUS)) > 0)
+        {
+          affinity = MAT_AFFINITY_LIST;
+        }
+        else
+        {
+          fprintf(stderr, "Bad argument for '-A': %s\n", optarg);
+          ret = -1;
+        }
+        break;
+      case 'a':
+        if(!strcmp(optarg, "naive"))
+        {
+          algorithm = MAT_NAIVE;
+        }
+        else if(!strcmp(optarg, "packed"))
+        {
+          algorithm = MAT_PACKED;
+        }
+        else if(!strcmp(optarg, "transpose"))
+        {
+          algorithm = MAT_TRANSPOSED;
+        }
+        else
+        {
+          fprintf(stderr, "Bad argument for '-a': %s\n", optarg);
+          ret = -1;
+        }
+        break;
       default:
         fprintf(stderr, "Bad option (%c)\n", optopt);
         ret = -1;
@@ -322,8 +1318,13 @@ int parse_cmdline(int argc, char** argv,
   }
 
   configuration->print_matrix = print_matrix;
-  configuration->m = m;
+  configuration->m = dims[0] ? (size_t)dims[0] : (size_t)m;
+  configuration->w = dims[1] ? (size_t)dims[1] : (size_t)m;
+  configuration->n = dims[2] ? (size_t)dims[2] : (size_t)m;
   configuration->threads = (size_t)threads;
+  configuration->algorithm = algorithm;
+  configuration->repeat = (size_t)repeat;
+  configuration->affinity = affinity;
 
   return ret;
 }
@@ -336,15 +1337,18 @@ int parse_cmdline(int argc, char** argv,
  */
 int main(int argc, char** argv)
 {
-  uint64_t* mat1 = NULL;
-  uint64_t* mat2 = NULL;
-  uint64_t* mat3 = NULL;
+  mat_elem_t* mat1 = NULL;
+  mat_elem_t* mat2 = NULL;
+  mat_elem_t* mat2t = NULL;
+  mat_elem_t* mat3 = NULL;
   size_t m = DEFAULT_ROW_SIZE;
   size_t n = DEFAULT_COLUMN_SIZE;
   size_t w = DEFAULT_COLUMN_SIZE;
   int print_matrix = 0;
   size_t threads = 0;
   struct configuration config;
+  struct mat_pool pool;
+  struct mat_topology topo;
   size_t nb_elements = 0;
   double start = 0;
   double end = 0;
@@ -362,16 +1366,16 @@ int main(int argc, char** argv)
   }
 
   m = config.m;
-  n = config.m;
-  w = config.m;
+  n = config.n;
+  w = config.w;
   print_matrix = config.print_matrix;
   threads = config.threads;
 
   nb_elements = m * n;
 
-  mat1 = malloc(nb_elements * sizeof(uint64_t));
-  mat2 = malloc(nb_elements * sizeof(uint64_t));
-  mat3 = malloc(nb_elements * sizeof(uint64_t));
+  mat1 = mat_alloc(m * w);
+  mat2 = mat_alloc(w * n);
+  mat3 = mat_alloc(nb_elements);
 
   if(!mat1 || !mat2 || !mat3)
   {
@@ -382,20 +1386,70 @@ int main(int argc, char** argv)
     exit(EXIT_FAILURE);
   }
 
-  mat_init(mat1, mat2, m, n);
+  mat_topology_load(&topo);
+
+  {
+    int cpus[threads];
+
+    if(config.affinity != MAT_AFFINITY_NONE)
+    {
+      mat_affinity_cpus(&topo, &config, cpus);
+    }
+
+    ret = mat_pool_init(&pool, threads,
+        config.affinity != MAT_AFFINITY_NONE ? cpus : NULL);
+  }
+
+  if(ret == -1)
+  {
+    fprintf(stderr, "Thread pool cannot be created\n");
+    free(mat1);
+    free(mat2);
+    free(mat3);
+    exit(EXIT_FAILURE);
+  }
+
+  /* first-touch by workers places their rows on their NUMA node */
+  mat_pool_init_matrixes(&pool, mat1, mat2, mat3, m, n, w);
 
   if(print_matrix)
   {
     printf("Matrix 1:\n");
-    mat_print(mat1, m, n);
+    mat_print(mat1, m, w);
     printf("Matrix 2:\n");
-    mat_print(mat2, m, n);
+    mat_print(mat2, w, n);
   }
 
   fprintf(stdout, "Compute with %zu thread(s)\n", threads);
 
+  if(config.algorithm == MAT_PACKED)
+  {
+    fprintf(stdout, "Packed kernel: %s\n", mat_kernel_default()->name);
+  }
+  else if(config.algorithm == MAT_TRANSPOSED)
+  {
+    mat2t = mat_transpose_timed(mat2, n, w, mat_pool_transpose, &pool);
+
+    if(!mat2t)
+    {
+      perror("malloc");
+      mat_pool_destroy(&pool);
+      free(mat1);
+      free(mat2);
+      free(mat3);
+      exit(EXIT_FAILURE);
+    }
+  }
+
   start = util_gettime_us();
-  if(mat_mult_pthread(mat1, mat2, mat3, m, n, w, threads) == -1)
+  ret = 0;
+  for(size_t i = 0 ; i < config.repeat && ret == 0 ; i++)
+  {
+    ret = mat_pool_mult(&pool, mat1, mat2t ? mat2t : mat2, mat3, m, n, w,
+        config.algorithm);
+  }
+
+  if(ret == -1)
   {
     fprintf(stderr, "Matrixes cannot be multiplied\n");
     ret = EXIT_FAILURE;
@@ -404,7 +1458,35 @@ int main(int argc, char** argv)
   {
     end = util_gettime_us();
 
-    fprintf(stdout, "Multiplication success: %f ms\n", (end - start) / 1000);
+    fprintf(stdout, "Multiplication success: %f ms\n",
+        (end - start) / 1000 / config.repeat);
+
+    if(config.repeat > 1)
+    {
+      double pool_us = 0;
+      double create_us = 0;
+
+      mat_pool_latency(&pool, config.repeat, &pool_us, &create_us);
+      fprintf(stdout, "Dispatch latency: %f us (pool), %f us "
+          "(create/join)\n", pool_us, create_us);
+    }
+
+    if(config.affinity != MAT_AFFINITY_NONE)
+    {
+      size_t local = 0;
+      size_t remote = 0;
+
+      if(mat_numa_pages(&pool, &topo, mat1, mat3, m, n, w, &local,
+            &remote) == 0)
+      {
+        fprintf(stdout, "NUMA pages of bands: %zu local, %zu remote "
+            "(%zu node(s))\n", local, remote, topo.nb_nodes);
+      }
+      else
+      {
+        fprintf(stdout, "NUMA pages of bands: not available\n");
+      }
+    }
 
     if(print_matrix)
     {
@@ -414,8 +1496,10 @@ int main(int argc, char** argv)
   }
 
   /* free resources */
+  mat_pool_destroy(&pool);
   free(mat1);
   free(mat2);
+  free(mat2t);
   free(mat3);
 
   return ret;